@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Compression ratio and throughput as a function of block size.
+#
+# usage: bench/blocksize.sh [input-file] [block sizes in Kbytes...]
+#
+# Run from the top of the repository after "make".  Without an input file, a log-like input of $BENCH_MB Mbytes (default 64) is
+# generated.  Each block size is used to compress and then decompress the input
+# with bin/sequitur; the round trip is checked, and the compressed size, ratio
+# and throughput of both directions are printed.
+
+SEQ=${SEQ:-bin/sequitur}
+TMP=${TMPDIR:-/tmp}/seqbench.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+case $1 in
+    ''|*[!0-9]*) INPUT=$1 ;;
+    *) INPUT= ;;
+esac
+if [ -n "$INPUT" ]; then
+    [ -f "$INPUT" ] || { echo "$INPUT: no such file"; exit 1; }
+    shift
+else
+    INPUT=$TMP/input.log
+    awk -v mb="${BENCH_MB:-64}" 'BEGIN {
+        srand(1);
+        split("INFO INFO INFO WARN ERROR DEBUG", lvl, " ");
+        split("GET POST PUT DELETE", verb, " ");
+        limit = mb * 1024 * 1024;
+        while(size < limit) {
+            line = sprintf("2026-10-%02d %02d:%02d:%02d [%s] worker-%d %s /api/v1/item/%d id=%d took %dms\n",
+                           1 + int(rand() * 28), int(rand() * 24), int(rand() * 60), int(rand() * 60),
+                           lvl[1 + int(rand() * 6)], int(rand() * 16), verb[1 + int(rand() * 4)],
+                           int(rand() * 5000), int(rand() * 1000000), int(rand() * 1000));
+            printf "%s", line;
+            size += length(line);
+        }
+    }' > "$INPUT"
+fi
+[ $# -gt 0 ] || set -- 1 64 1024 4096 16384 65535
+
+now() { date +%s%N; }
+SIZE=$(wc -c < "$INPUT")
+printf "input: %s (%d bytes)\n" "$INPUT" "$SIZE"
+printf "%10s %12s %8s %12s %12s\n" "block KB" "compressed" "ratio" "comp MB/s" "decomp MB/s"
+for b in "$@"; do
+    t0=$(now)
+    "$SEQ" -c -b "$b" < "$INPUT" > "$TMP/out.seq" || { echo "compress -b $b failed"; continue; }
+    t1=$(now)
+    "$SEQ" -d < "$TMP/out.seq" > "$TMP/out.raw" || { echo "decompress -b $b failed"; continue; }
+    t2=$(now)
+    cmp -s "$INPUT" "$TMP/out.raw" || echo "round trip mismatch at -b $b"
+    CSIZE=$(wc -c < "$TMP/out.seq")
+    awk -v b="$b" -v c="$CSIZE" -v s="$SIZE" -v tc=$((t1 - t0)) -v td=$((t2 - t1)) 'BEGIN {
+        printf "%10d %12d %8.3f %12.2f %12.2f\n", b, c, s / c, s / 1048576 / (tc / 1e9), s / 1048576 / (td / 1e9)
+    }'
+done
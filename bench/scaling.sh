@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Throughput of block-parallel compression and decompression as a function of the
+# number of threads.
+#
+# usage: bench/scaling.sh [block size in Kbytes] [input files...]
+#
+# Run from the top of the repository after "make".  Without input files, the 2MB
+# test corpus is used, together with log-like inputs of $BENCH_MB Mbytes (default
+# 16 and 128) that are generated for the purpose.  Each input is compressed with
+# -j 1, 2, 4, ... up to the number of cores ($BENCH_JOBS to override), and then
+# decompressed with the same number of threads.  The compressed output of every
+# run is checked to be identical to that of -j 1, and the round trip is checked.
+
+SEQ=${SEQ:-bin/sequitur}
+TMP=${TMPDIR:-/tmp}/seqscale.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+BLOCK=1024
+case $1 in
+    ''|*[!0-9]*) ;;
+    *) BLOCK=$1; shift ;;
+esac
+
+generate() {
+    awk -v mb="$1" 'BEGIN {
+        srand(1);
+        split("INFO INFO INFO WARN ERROR DEBUG", lvl, " ");
+        split("GET POST PUT DELETE", verb, " ");
+        limit = mb * 1024 * 1024;
+        while(size < limit) {
+            line = sprintf("2026-10-%02d %02d:%02d:%02d [%s] worker-%d %s /api/v1/item/%d id=%d took %dms\n",
+                           1 + int(rand() * 28), int(rand() * 24), int(rand() * 60), int(rand() * 60),
+                           lvl[1 + int(rand() * 6)], int(rand() * 16), verb[1 + int(rand() * 4)],
+                           int(rand() * 5000), int(rand() * 1000000), int(rand() * 1000));
+            printf "%s", line;
+            size += length(line);
+        }
+    }' > "$2"
+}
+
+if [ $# -eq 0 ]; then
+    set -- tests/inputs/2mb_text_1024.txt
+    for mb in ${BENCH_MB:-16 128}; do
+        generate "$mb" "$TMP/input$mb.log"
+        set -- "$@" "$TMP/input$mb.log"
+    done
+fi
+
+CORES=${BENCH_JOBS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)}
+JOBS=1
+j=2
+while [ "$j" -lt "$CORES" ]; do
+    JOBS="$JOBS $j"
+    j=$((j * 2))
+done
+[ "$CORES" -gt 1 ] && JOBS="$JOBS $CORES"
+
+now() { date +%s%N; }
+printf "block size %d KB, up to %d threads\n" "$BLOCK" "$CORES"
+printf "%-36s %6s %12s %10s %12s %10s %8s\n" "input" "jobs" "comp MB/s" "speedup" "decomp MB/s" "speedup" "output"
+for input in "$@"; do
+    [ -f "$input" ] || { echo "$input: no such file"; continue; }
+    SIZE=$(wc -c < "$input")
+    BASE=
+    DBASE=
+    for j in $JOBS; do
+        t0=$(now)
+        "$SEQ" -c -b "$BLOCK" -j "$j" < "$input" > "$TMP/out$j.seq" || { echo "compress -j $j failed"; continue; }
+        t1=$(now)
+        "$SEQ" -d -j "$j" < "$TMP/out1.seq" > "$TMP/out.raw" || { echo "decompress -j $j failed"; continue; }
+        t2=$(now)
+        [ -n "$BASE" ] || BASE=$((t1 - t0))
+        [ -n "$DBASE" ] || DBASE=$((t2 - t1))
+        if cmp -s "$TMP/out1.seq" "$TMP/out$j.seq"; then same=same; else same=DIFFERS; fi
+        cmp -s "$input" "$TMP/out.raw" || same="$same,BAD"
+        awk -v f="$input" -v j="$j" -v s="$SIZE" -v t=$((t1 - t0)) -v b="$BASE" -v td=$((t2 - t1)) -v db="$DBASE" \
+            -v same="$same" 'BEGIN {
+            printf "%-36s %6d %12.2f %10.2f %12.2f %10.2f %8s\n", substr(f, length(f) > 36 ? length(f) - 35 : 1), j,
+                   s / 1048576 / (t / 1e9), b / t, s / 1048576 / (td / 1e9), db / td, same
+        }'
+    done
+done
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# File-to-file compression and decompression with and without io_uring (-u),
+# starting from a cold page cache.
+#
+# usage: bench/uring.sh [block size in Kbytes] [input-file]
+#
+# Run from the top of the repository after "make".  Without an input file, a
+# log-like input of $BENCH_MB Mbytes (default 256) is generated.  Before each run
+# the input is evicted from the page cache (with dd iflag=nocache, which needs no
+# privileges), so that it has to come from the disk, and the output is written to
+# a new file; the time includes a sync of the output.  Each run is repeated
+# $BENCH_RUNS times (default 3), and the best time is kept.  The outputs of the
+# two modes are checked to be identical.
+
+SEQ=${SEQ:-bin/sequitur}
+TMP=${TMPDIR:-/tmp}/sequring.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+BLOCK=1024
+case $1 in
+    ''|*[!0-9]*) ;;
+    *) BLOCK=$1; shift ;;
+esac
+
+INPUT=$1
+if [ -n "$INPUT" ]; then
+    [ -f "$INPUT" ] || { echo "$INPUT: no such file"; exit 1; }
+else
+    INPUT=$TMP/input.log
+    awk -v mb="${BENCH_MB:-256}" 'BEGIN {
+        srand(1);
+        split("INFO INFO INFO WARN ERROR DEBUG", lvl, " ");
+        split("GET POST PUT DELETE", verb, " ");
+        limit = mb * 1024 * 1024;
+        while(size < limit) {
+            line = sprintf("2026-10-%02d %02d:%02d:%02d [%s] worker-%d %s /api/v1/item/%d id=%d took %dms\n",
+                           1 + int(rand() * 28), int(rand() * 24), int(rand() * 60), int(rand() * 60),
+                           lvl[1 + int(rand() * 6)], int(rand() * 16), verb[1 + int(rand() * 4)],
+                           int(rand() * 5000), int(rand() * 1000000), int(rand() * 1000));
+            printf "%s", line;
+            size += length(line);
+        }
+    }' > "$INPUT"
+fi
+"$SEQ" -c -b "$BLOCK" -i "$INPUT" -o "$TMP/input.seq" || { echo "compress failed"; exit 1; }
+sync
+
+now() { date +%s%N; }
+evict() { dd if="$1" iflag=nocache count=0 status=none; }
+
+# run <mode> <flags> <input> <output>: best time in nanoseconds
+run() {
+    best=
+    i=0
+    while [ "$i" -lt "${BENCH_RUNS:-3}" ]; do
+        rm -f "$4"
+        evict "$3"
+        t0=$(now)
+        "$SEQ" $2 $1 -i "$3" -o "$4" || { echo "$SEQ $2 $1 failed" >&2; return 1; }
+        sync "$4"
+        t=$(($(now) - t0))
+        [ -z "$best" ] || [ "$t" -lt "$best" ] && best=$t
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+SIZE=$(wc -c < "$INPUT")
+printf "input: %s (%d bytes), block size %d KB\n" "$INPUT" "$SIZE" "$BLOCK"
+printf "%-12s %14s %14s %10s\n" "" "blocking MB/s" "io_uring MB/s" "speedup"
+for dir in compress decompress; do
+    if [ $dir = compress ]; then
+        flags="-c -b $BLOCK"; in=$INPUT; ext=seq
+    else
+        flags="-d"; in=$TMP/input.seq; ext=raw
+    fi
+    t=$(run "" "$flags" "$in" "$TMP/out.$ext") || exit 1
+    cp "$TMP/out.$ext" "$TMP/blocking.$ext"
+    tu=$(run "-u" "$flags" "$in" "$TMP/out.$ext") || exit 1
+    cmp -s "$TMP/blocking.$ext" "$TMP/out.$ext" || echo "$dir: outputs differ"
+    awk -v d=$dir -v s="$SIZE" -v t="$t" -v tu="$tu" 'BEGIN {
+        printf "%-12s %14.2f %14.2f %10.2f\n", d, s / 1048576 / (t / 1e9), s / 1048576 / (tu / 1e9), t / tu
+    }'
+done
@@ -13,16 +13,34 @@
 
 #define USAGE(program_name, retcode) do { \
 fprintf(stderr, "USAGE: %s %s\n", program_name, \
-"[-h] -c|-d [-b]\n" \
+"[-h] -c|-d [-b] [-j|-p|-u] [-i FILE] [-o FILE]\n" \
 "   -h       Help: displays this help menu.\n" \
 "   -c       Compress: read bytes from standard input, output compressed data to standard output.\n" \
 "   -d       Decompress: read compressed data from standard input, output raw data to standard output.\n" \
-"            Optional additional parameter for -c (not permitted with -d):\n" \
-"               -b           BLOCKSIZE is the blocksize (in Kbytes, range [1, 1024])\n" \
-"                            to be used in compression.\n"); \
+"            Optional additional parameters for -c (not permitted with -d):\n" \
+"               -b           BLOCKSIZE is the blocksize (in Kbytes, range [1, 65535])\n" \
+"                            to be used in compression.\n" \
+"               -p           Pipelined: read, compress and write on separate threads\n" \
+"                            (not permitted with -j).\n" \
+"            Optional additional parameters for -c or -d:\n" \
+"               -j           JOBS is the number of threads (range [1, 255]) that\n" \
+"                            compress or decompress blocks at the same time.\n" \
+"               -u           Asynchronous: keep reads and writes of files in flight\n" \
+"                            with io_uring (not permitted with -j or -p).\n" \
+"               -i           Read input from FILE instead of standard input.\n" \
+"               -o           Write output to FILE instead of standard output.\n"); \
 exit(retcode); \
 } while(0)
 
+/* The largest blocksize (in Kbytes) that fits in the 16 bits global_options has for it. */
+#define BLOCKSIZE_MAX 65535
+
+/*
+ * The largest number of threads for -j, which global_options keeps in bits 8-15.
+ * Zero there means that -j was not given, which is the same as one thread.
+ */
+#define JOBS_MAX 255
+
 /*
  * The following global variables have been provided for you.
  * You MUST use them for their stated purposes, because you are not permitted
@@ -32,27 +50,29 @@ exit(retcode); \
  */
 
 /* Options info, set by validargs. */
-int global_options;
-
-/* Statically allocated storage for symbols. */
-SYMBOL symbol_storage[MAX_SYMBOLS];
-
-/* Total number of symbols allocated from symbol_storage. */
-int num_symbols;
+extern int global_options;
 
-/* Storage for the digram hash table, which maps pairs of symbol values to digrams. */
-SYMBOL *digram_table[MAX_DIGRAMS];
+/* Files named with -i and -o, set by validargs; NULL for standard input and output. */
+extern char *input_path;
+extern char *output_path;
 
 /*
- * The "main rule", which heads the list of rules generated by the compression algorithm
- * (during compression) or read in as input (during decompression).
- */
-SYMBOL *main_rule;
-
-/*
- * Array, used during decompression, that maps symbol values to nonterminal symbols.
+ * The state of the compression engine is kept in a context (see SEQ_CONTEXT in
+ * sequitur.h), and the following names stand for fields of the current context:
+ *
+ *   symbol_chunks   Directory of the chunks of storage for symbols, which is
+ *                   prepared by reserve_symbols() and grown by new_symbol().
+ *   num_symbols     Total number of symbols allocated from symbol storage.
+ *   digram_table    Storage for the digram hash table, which maps pairs of symbol
+ *                   values to digrams.  Allocated by reserve_digrams().
+ *   main_rule       The "main rule", which heads the list of rules generated by the
+ *                   compression algorithm (during compression) or read in as input
+ *                   (during decompression).
+ *   rule_data       Array of SYMBOL_VALUE_MAX + 1 entries that maps symbol values to
+ *                   rules: it holds the head, the reference count and the links in
+ *                   the list of all rules for the rule whose head has a given value.
+ *                   Allocated by map_rule() when the first rule is entered.
  */
-SYMBOL *rule_map[SYMBOL_VALUE_MAX];
 
 /*
  * Below this line are prototypes for functions that MUST occur in your program.
@@ -68,9 +88,19 @@ SYMBOL *rule_map[SYMBOL_VALUE_MAX];
 int validargs(int argc, char **argv);
 
 int decompress(FILE *in, FILE *out);
+int decompress_parallel(FILE *in, FILE *out, int jobs);
 int compress(FILE *in, FILE *out, int bsize);
+int compress_parallel(FILE *in, FILE *out, int bsize, int jobs);
+int compress_pipeline(FILE *in, FILE *out, int bsize);
+int compress_uring(FILE *in, FILE *out, int bsize);
+int decompress_uring(FILE *in, FILE *out);
+
+FILE *open_input(void);
+FILE *open_output(FILE *in, int compressing);
+int close_output(FILE *out);
 
 void init_symbols(void);
+int reserve_symbols(int count);
 SYMBOL *new_symbol(int value, SYMBOL *rule);
 void recycle_symbol(SYMBOL *s);
 
@@ -80,8 +110,12 @@ void add_rule(SYMBOL *rule);
 void delete_rule(SYMBOL *rule);
 SYMBOL *ref_rule(SYMBOL *rule);
 void unref_rule(SYMBOL *rule);
+void map_rule(SYMBOL *rule);
+int new_rule_value(void);
+int rule_values_left(void);
 
 void init_digram_hash(void);
+int reserve_digrams(int count);
 SYMBOL *digram_get(int v1, int v2);
 int digram_delete(SYMBOL *first);
 int digram_put(SYMBOL *first);
@@ -0,0 +1,50 @@
+#ifndef LIBSEQUITUR_H
+#define LIBSEQUITUR_H
+
+#include <stddef.h>
+
+/*
+ * libsequitur: the Sequitur compressor, to be used from other programs.
+ *
+ * An encoder turns bytes into a compressed data transmission, and a decoder turns
+ * a transmission back into bytes, a piece at a time and without streams:
+ *
+ *    SEQ_STREAM *s = seq_new_encoder(1 << 20);    (or seq_new_decoder())
+ *    seq_update(s, data, length);                  as often as there is input
+ *    seq_pull(s, buffer, size);                    as often as there is output
+ *    seq_finish(s);                                at the end of the input
+ *    seq_pull(s, buffer, size);                    until it returns 0
+ *    seq_free(s);
+ *
+ * Input may be pushed in pieces of any size.  The transmission that an encoder
+ * produces is exactly the one that "sequitur -c" produces from the same bytes with
+ * the same block size, and a decoder accepts exactly what "sequitur -d" accepts.
+ * Output is kept by the stream until it is pulled, so it can be pulled whenever
+ * it is convenient; an encoder produces its output a block at a time, and a
+ * decoder as each block of the transmission is complete.
+ *
+ * Each stream has a compression context of its own, so any number of streams can
+ * be used in one process, and different threads can use different streams at the
+ * same time.  A single stream must not be used by two threads at once.
+ */
+
+/*
+ * The library is built with -fvisibility=hidden, so these are the only symbols
+ * it exports.
+ */
+#if defined(__GNUC__)
+#define SEQ_API __attribute__((visibility("default")))
+#else
+#define SEQ_API
+#endif
+
+typedef struct seq_stream SEQ_STREAM;
+
+SEQ_API SEQ_STREAM *seq_new_encoder(int bsize);
+SEQ_API SEQ_STREAM *seq_new_decoder(void);
+SEQ_API int seq_update(SEQ_STREAM *s, const void *data, size_t length);
+SEQ_API size_t seq_pull(SEQ_STREAM *s, void *buffer, size_t size);
+SEQ_API int seq_finish(SEQ_STREAM *s);
+SEQ_API void seq_free(SEQ_STREAM *s);
+
+#endif
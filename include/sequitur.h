@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "debug.h"
 
@@ -25,44 +26,82 @@
  * compressed or decompressed, and the value of a nonterminal symbol has no particular
  * significance other than to distinguish one particular nonterminal symbol from another.
  *
- * Each symbol also has some pointer fields, which we will use to chain symbols together
+ * Each symbol also has some link fields, which we will use to chain symbols together
  * into lists.  The "next" and "prev" fields will be used to chain symbols together
- * as a doubly linked list to form the body of a rule.  The "nextr" and "prevr" fields
- * will be used to link the heads of rules (which will be represented by nonterminal
- * symbols) into a doubly linked list.  There is also a "refcnt" field, which is used
- * by the compression algorithm to maintain a count of the number of times a rule has
- * been used.  Refer to the assignment document for further discussion on the use of these
- * various fields.
+ * as a doubly linked list to form the body of a rule.  Links are not pointers, but
+ * 32-bit references (see SYMREF below) to other symbols in symbol storage, which
+ * keeps a symbol down to 12 bytes.
+ * Everything else about a rule lives in a table of RULE_DATA indexed by the value
+ * of its head (see below): the head itself, which a nonterminal symbol with the same
+ * value refers to, the "nextr" and "prevr" links, which chain the heads of all rules
+ * into a doubly linked list, and the "refcnt" field, which is used by the compression
+ * algorithm to maintain a count of the number of times a rule has been used.  Only
+ * rules need these, so the symbols in rule bodies, which are by far the most numerous
+ * and are what the algorithm walks, do not have to carry them.  Refer to the assignment
+ * document for further discussion on the use of these various fields.
  */
+
+/*
+ * A reference to a symbol: one more than the number of the symbol in symbol storage,
+ * so that the reference 0 can stand for "no symbol", as NULL does for pointers.
+ */
+typedef uint32_t SYMREF;
+
 typedef struct symbol {
     unsigned int value;        // The value that uniquely identifies the symbol.
-    unsigned int refcnt;       // Reference count if symbol is head of a rule, otherwise 0
-    struct symbol *rule;       // NULL for terminal, non-NULL for nonterminal or sentinel
-    struct symbol *next;       // Next symbol in rule body (or the sentinel, in case of last symbol)
-    struct symbol *prev;       // Previous symbol in rule body (or the sentinel, in case of first symbol)
-    struct symbol *nextr;      // If sentinel, next rule in list of all rules.
-    struct symbol *prevr;      // If sentinel, previous rule in list of all rules.
+    SYMREF next;               // Next symbol in rule body (or the sentinel, in case of last symbol)
+    SYMREF prev;               // Previous symbol in rule body (or the sentinel, in case of first symbol)
 } SYMBOL;
 
+/*
+ * The fields of a rule.  The table of these (the definition is in const.h) is indexed
+ * by the value of the head, which identifies the rule.  Values are handed out
+ * consecutively from FIRST_NONTERMINAL during compression, so the part of the table
+ * in use is dense.
+ *
+ * Like the digram table, the table is cleared for a new block by advancing a
+ * generation, rule_generation, rather than by touching its entries: a head only
+ * counts if it was entered in the current generation (see RULE_HEAD).  Generation
+ * 0 is never current, so a freshly allocated table has no heads.
+ */
+typedef struct rule_data {
+    SYMREF head;               // Head of the rule with this value, 0 if there is none
+    uint32_t generation;       // Generation of the table in which head was entered
+    unsigned int refcnt;       // Reference count of the rule
+    SYMREF nextr;              // Next rule in list of all rules.
+    SYMREF prevr;              // Previous rule in list of all rules.
+} RULE_DATA;
+
+/* Largest generation of the table of RULE_DATA before it must really be cleared. */
+#define RULE_GENERATION_MAX UINT32_MAX
+
+/*
+ * The table of RULE_DATA, rule_data, is indexed by the value of the head.  Like the rest
+ * of the state of the compression engine, it belongs to a SEQ_CONTEXT (see the end
+ * of this file).
+ */
+
+/*
+ * The value given to a symbol while it is on the recycle stack.  No symbol that is
+ * in use has it, and the table of RULE_DATA has an entry for it that never has a head.
+ */
+#define RECYCLED_VALUE SYMBOL_VALUE_MAX
+
 /* The first symbol value that is used for nonterminal symbols. */
 #define FIRST_NONTERMINAL 256
 
-/* The following macros are used to inspect a symbol to determine what type it is. */
-#define IS_TERMINAL(s) ((s)->value < FIRST_NONTERMINAL)
-#define IS_NONTERMINAL(s) (!IS_TERMINAL(s))
-#define IS_RULE_HEAD(s) ((s)->rule == (s))
-
 /*
- * The following counter is used to allocate fresh values when new nonterminal symbols
- * need to be created.  It is initialized elsewhere, because to initialize it here
- * would result in a "multiple definition" link error, due to the inclusion of this
- * header in multiple source files.
+ * The counter next_nonterminal_value (a field of the current SEQ_CONTEXT) is used to
+ * allocate fresh values when new nonterminal symbols need to be created.  It starts
+ * out as FIRST_NONTERMINAL.
  */
-extern int next_nonterminal_value /* = FIRST_NONTERMINAL */;
 
 /*
- * We will not use general-purpose dynamic storage allocation (i.e. "malloc").
- * Instead, we statically declare an array of a fixed number of SYMBOL structures.
+ * Symbols are not allocated one at a time with malloc.  Instead, SYMBOL structures
+ * are allocated in "chunks" of SYMBOL_CHUNK symbols each, and symbol number i lives
+ * in chunk i / SYMBOL_CHUNK.  A chunk is allocated the first time a symbol in it is
+ * needed and is kept for reuse by later blocks, so storage grows with the data
+ * actually processed and symbols never move once they have been handed out.
  * We will keep track of the number of such structures that are in use, and when
  * we need another one, we will use the first unused one.  This will suffice for
  * the decompression algorithm, where we only ever allocate symbols and never
@@ -72,20 +111,93 @@ extern int next_nonterminal_value /* = FIRST_NONTERMINAL */;
  * being used.
  */
 
-/* The total number of pre-allocated symbols that we have at our disposal. */
+/* The number of symbols reserved when nothing is known about the size of the input. */
 #define MAX_SYMBOLS 1000000
 
+/* The number of symbols in one chunk of symbol storage, which must be a power of two. */
+#define SYMBOL_CHUNK_BITS 16
+#define SYMBOL_CHUNK (1 << SYMBOL_CHUNK_BITS)
+
+/*
+ * Each chunk starts on a multiple of SYMBOL_CHUNK_ALIGN bytes, and the SYMBOL just
+ * past its last symbol holds the number of the chunk in its value field.  A pointer
+ * to a symbol therefore leads to the start of its chunk by masking, and from there
+ * to the number of the chunk, which is what makes SYMBOL_REF constant time.  The
+ * alignment covers a chunk and that extra SYMBOL as long as a SYMBOL is smaller than
+ * 16 bytes; the part of it that is not used is never touched.
+ */
+#define SYMBOL_CHUNK_ALIGN ((size_t)16 << SYMBOL_CHUNK_BITS)
+
+/*
+ * An upper bound on the number of symbols needed to compress a block of n bytes.
+ * Rule bodies never hold more than n symbols in total, and every rule has at least
+ * two symbols in its body, so the heads of rules add at most n/2; the rest is
+ * headroom for the symbols that are briefly in use while a rule is being formed.
+ */
+#define BLOCK_SYMBOLS(n) (2 * (n) + 16)
+
 /* The maximum number of nonterminal symbols (limited by 2^21 Unicode code points). */
 #define SYMBOL_VALUE_MAX (1 << 21)
 
-/* Statically allocated storage for symbols (definition is in const.h). */
-extern SYMBOL symbol_storage[/*MAX_SYMBOLS*/];
+/*
+ * The largest value a nonterminal symbol can have, as it must be written out as a
+ * Unicode code point.  Once a block has used up all the values up to this one,
+ * values of rules that have been deleted are used again.
+ */
+#define LAST_NONTERMINAL 0x10FFFF
+
+/*
+ * Symbols are kept in the chunks listed in the directory symbol_chunks, and num_symbols
+ * is the total number of symbols that have been allocated from them.  Both are fields
+ * of the current SEQ_CONTEXT.
+ */
+
+/* Given the number of a symbol, obtain a pointer to it in symbol storage. */
+#define SYMBOL_AT(i) (*(symbol_chunks + ((i) >> SYMBOL_CHUNK_BITS)) + ((i) & (SYMBOL_CHUNK - 1)))
+
+/* Given a pointer to a symbol, obtain the start of the chunk that holds it. */
+#define SYMBOL_CHUNK_BASE(s) ((SYMBOL *)((uintptr_t)(s) & ~(uintptr_t)(SYMBOL_CHUNK_ALIGN - 1)))
 
-/* Total number of symbols that have been allocated from symbol_storage. */
-extern int num_symbols;
+/* Given a pointer to a symbol, obtain the number of the symbol in symbol storage. */
+#define SYMBOL_INDEX(s) \
+    (((unsigned long)(SYMBOL_CHUNK_BASE(s) + SYMBOL_CHUNK)->value << SYMBOL_CHUNK_BITS) \
+     + (unsigned long)((SYMBOL *)(s) - SYMBOL_CHUNK_BASE(s)))
 
-/* Given a pointer to a symbol, obtain the index of the symbol in the symbol_storage array. */
-#define SYMBOL_INDEX(s) ((s) - symbol_storage)
+/* Conversions between pointers to symbols and references to them. */
+#define SYMBOL_REF(s) ((s) == NULL ? 0 : (SYMREF)SYMBOL_INDEX(s) + 1)
+#define SYMBOL_PTR(r) ((r) == 0 ? NULL : SYMBOL_AT((r) - 1))
+
+/* The following macros follow the links of a symbol, as pointers. */
+#define NEXT(s) SYMBOL_PTR((s)->next)
+#define PREV(s) SYMBOL_PTR((s)->prev)
+
+/* The following macros set the links of a symbol from pointers. */
+#define SET_NEXT(s, p) ((s)->next = SYMBOL_REF(p))
+#define SET_PREV(s, p) ((s)->prev = SYMBOL_REF(p))
+
+/* The following macros are used to inspect a symbol to determine what type it is. */
+#define IS_TERMINAL(s) ((s)->value < FIRST_NONTERMINAL)
+#define IS_NONTERMINAL(s) (!IS_TERMINAL(s))
+#define IS_RULE_HEAD(s) (IS_NONTERMINAL(s) && RULE_HEAD(RULE_DATA_OF(s)) == SYMBOL_REF(s))
+
+/*
+ * The following macros access the RULE_DATA of the rule headed by a given symbol,
+ * or of the rule that a nonterminal symbol in a rule body refers to.
+ */
+#define RULE_DATA_OF(h) (rule_data + (h)->value)
+#define RULE_HEAD(d) ((d)->generation == rule_generation ? (d)->head : 0)
+#define REFCNT(h) (RULE_DATA_OF(h)->refcnt)
+#define NEXTR(h) SYMBOL_PTR(RULE_DATA_OF(h)->nextr)
+#define PREVR(h) SYMBOL_PTR(RULE_DATA_OF(h)->prevr)
+#define SET_NEXTR(h, p) (RULE_DATA_OF(h)->nextr = SYMBOL_REF(p))
+#define SET_PREVR(h, p) (RULE_DATA_OF(h)->prevr = SYMBOL_REF(p))
+
+/*
+ * The head of the rule a symbol refers to: NULL for a terminal symbol, the symbol
+ * itself for a sentinel, or the head of the rule for a nonterminal (NULL if no rule
+ * with that value has been created yet).
+ */
+#define RULE(s) (IS_TERMINAL(s) ? NULL : SYMBOL_PTR(RULE_HEAD(RULE_DATA_OF(s))))
 
 /*
  * RULES
@@ -103,11 +215,11 @@ extern int num_symbols;
  *
  * The "next" and "prev" fields of the SYMBOL structure are used to chain symbols
  * together into a rule.  We refer to a rule using a pointer to the sentinel node H.
- * Sentinel nodes are distinguishable from other nodes by virtue of their having
- * a non-NULL "rule" field that points back to the sentinel node itself.
+ * Sentinel nodes are distinguishable from other nodes by virtue of being recorded
+ * as the head in the RULE_DATA for their value.
  *
  * We also link rule heads together into a circular, doubly linked list of all rules,
- * using the "nextr" and "prevr" fields of the SYMBOL structure.  This list does not
+ * using the "nextr" and "prevr" fields of their RULE_DATA.  This list does not
  * use a sentinel node, but the global variable "main_rule" is used to point to a
  * distinguished "main rule" in the list, from which the other rules can be accessed:
  *
@@ -118,12 +230,11 @@ extern int num_symbols;
  */
 
 /*
- * The following variable (defined in const.h) points to the "main rule".
+ * The main_rule field of the current SEQ_CONTEXT points to the "main rule".
  * Note that when the first rule is assigned to it, the "nextr" and "prevr" fields
  * of that rule must be initialized to point back to the rule itself, in order
  * to properly represent a circular, doubly linked list with one element in it.
  */
-extern SYMBOL *main_rule;
 
 /*
  * DIGRAMS
@@ -139,32 +250,92 @@ extern SYMBOL *main_rule;
  * additional data structures for use in constructing the table, we will use an
  * "open-addressed" hash table, which simply consists of an array, each of whose entries
  * can be set to point to a digram currently in the table.  Completely unused entries
- * in the hash table have value NULL.  Deletions in an open-addressed hash table have
- * to be handled by leaving a "tombstone" (distinguishable from NULL) in place of the
- * deleted entry.  We define a special value TOMBSTONE for this purpose.
+ * in the hash table point to NULL.  Deletions in an open-addressed hash table are
+ * often handled by leaving a "tombstone" in place of the deleted entry, but tombstones
+ * are only reclaimed when the whole table is cleared, so over a long block with many
+ * deletions probe sequences would keep getting longer.  Instead, deletion uses
+ * "backward shift": the entries that follow the deleted one in its probe sequence
+ * are moved back to close the gap, so the table never contains tombstones and the
+ * cost of a lookup depends only on how full the table currently is.
  */
 
-/* The size of the digram hash table, which must be a prime number. */
-#define MAX_DIGRAMS 999983
+/*
+ * The size of the digram hash table, which is always a power of two.
+ * There can be no more digrams in the table than there are symbols, so
+ * reserve_digrams() makes the table at least twice as large as the number of
+ * symbols it is asked to provide for, and digram_put() doubles the table if it
+ * would otherwise become more than half full, so a block is never limited by the
+ * size that was reserved for it.  This keeps the expected length of a linear
+ * probe sequence below three slots.
+ * digram_bits is a field of the current SEQ_CONTEXT.
+ */
+#define DIGRAM_BITS digram_bits
+#define MAX_DIGRAMS (1 << DIGRAM_BITS)
+
+/*
+ * Each entry of the hash table records the digram's first symbol together with
+ * the packed key (see DIGRAM_KEY below) of the two symbol values it had when it
+ * was inserted.  Probing compares keys stored in the table itself, so deciding
+ * whether a slot matches does not require following the "first" pointer (and
+ * then its "next" pointer) out to symbol storage.  The key of an entry remains
+ * valid for as long as the entry is in the table, because a digram is always
+ * deleted before the link between its two symbols is changed.
+ *
+ * The bits of the key above the 42 bits of the two values hold the "generation"
+ * of the table in which the entry was made.  Clearing the table for a new block
+ * just advances digram_generation, which turns every entry of the previous block
+ * into an unused one without having to touch it.  Generation 0 is never current,
+ * so a slot whose key is zero (as in a freshly loaded program) is always unused.
+ */
+typedef struct digram_slot {
+    uint64_t key;              // Generation and DIGRAM_KEY of the digram's two values
+    SYMBOL *first;             // First symbol of the digram
+} DIGRAM_SLOT;
 
-/* Definition of the value to be used as a "tombstone" for deleted entries. */
-#define TOMBSTONE ((SYMBOL *)-1)
+/* The current generation of the digram table is digram_generation, in the current SEQ_CONTEXT. */
+
+/* Number of bits used by DIGRAM_KEY; generations are stored above these. */
+#define DIGRAM_KEY_BITS 42
+
+/* Largest generation that fits in a key before the table must really be cleared. */
+#define DIGRAM_GENERATION_MAX ((1ULL << (64 - DIGRAM_KEY_BITS)) - 1)
+
+/* A key stamped with the current generation, as it is stored in the table. */
+#define DIGRAM_STAMP(key) ((key) | (digram_generation << DIGRAM_KEY_BITS))
+
+/* Whether a slot holds an entry made in the current generation. */
+#define DIGRAM_SLOT_USED(slot) (((slot)->key >> DIGRAM_KEY_BITS) == digram_generation)
 
 /*
- * Statically allocated storage (the actual definition is in const.h) for the digram
- * hash table, which maps pairs of symbol values to digrams.
+ * Storage for the digram hash table, which maps pairs of symbol values to digrams,
+ * is digram_table, in the current SEQ_CONTEXT.
  */
-extern SYMBOL *digram_table[/*MAX_DIGRAMS*/];
 
 /*
  * Digram hash function: takes the two symbols of a digram and returns an
  * index into the hash table.  This index will serve as the starting point for
  * a "linear probing" search for a matching digram.  For further information on
- * open-addressed hash tables, linear probing, and deletion using tombstones,
+ * open-addressed hash tables, linear probing, and deletion by backward shift,
  * refer to your favorite Data Structures book or to
- * https://en.wikipedia.org/wiki/Open_addressing
+ * https://en.wikipedia.org/wiki/Open_addressing and
+ * https://en.wikipedia.org/wiki/Linear_probing#Deletion
+ *
+ * Symbol values fit in 21 bits, so the two values of a digram are packed into a
+ * single 42-bit key, with the first value in the high bits so that (a,b) and (b,a)
+ * are different keys.  The key is then scrambled by multiplying with 2^64 divided
+ * by the golden ratio, and the top DIGRAM_BITS bits of the product are used as the
+ * index ("Fibonacci hashing").  Every bit of the key affects those top bits, so
+ * digrams whose values have the same sum or differ only in low bits are spread
+ * over the whole table instead of piling up in one long probe sequence.
  */
-#define DIGRAM_HASH(v1, v2) (((v1) + (v2)) % MAX_DIGRAMS)
+#define DIGRAM_KEY(v1, v2) (((uint64_t)(v1) << 21) | (uint64_t)(v2))
+#define DIGRAM_KEY_HASH(key) \
+    ((int)((((uint64_t)(key) & ((1ULL << DIGRAM_KEY_BITS) - 1)) * 0x9E3779B97F4A7C15ULL) \
+           >> (64 - DIGRAM_BITS)))
+#define DIGRAM_HASH(v1, v2) DIGRAM_KEY_HASH(DIGRAM_KEY(v1, v2))
+
+/* The slot that follows a given slot in a probe sequence, wrapping around at the end. */
+#define DIGRAM_NEXT(index) (((index) + 1) & (MAX_DIGRAMS - 1))
 
 /*
  * FORMAT OF A COMPRESSED DATA TRANSMISSION
@@ -206,4 +377,207 @@ extern SYMBOL *digram_table[/*MAX_DIGRAMS*/];
 void insert_after(SYMBOL *old, SYMBOL *new);
 int check_digram(SYMBOL *this);
 
+/*
+ * CONTEXTS
+ *
+ * All of the state of the compression engine -- symbol storage, the rules and the digram
+ * table -- is kept in a SEQ_CONTEXT,
+ * so that several compressions can run at the same time in one process, one per context.
+ * Each thread has a "current" context, which is the one that all the functions of the
+ * engine work on.  A thread starts out with a default context, which is shared by all
+ * threads that have not chosen another one, so a program with only one thread never
+ * needs to know about contexts.  A different context is made current by use_context(),
+ * and context_compress() and context_decompress() are the forms of compress() and
+ * decompress() that run in a given context.
+ *
+ * The fields are known under their own names, which stand for the fields of the
+ * current context, so code written for the global state works unchanged.
+ */
+typedef struct seq_context {
+    /* Symbols (symbol.c) */
+    SYMBOL **symbol_chunks;          // Directory of the chunks of symbol storage
+    int symbol_chunk_slots;          // Number of entries in symbol_chunks
+    int num_symbols;                 // Number of symbols allocated from symbol storage
+    SYMBOL *recycled_symbols;        // Top of the stack of recycled symbols
+    int next_nonterminal_value;      // Next fresh value for the head of a rule
+
+    /* Rules (rules.c) */
+    SYMBOL *main_rule;               // The main rule, which heads the list of rules
+    RULE_DATA *rule_data;            // Table of rules, indexed by the value of the head
+    uint32_t rule_generation;        // Current generation of rule_data
+    int *free_rule_values;           // Stack of values of deleted rules
+    int free_rule_count;
+    int free_rule_slots;
+
+    /* Digram table (digram_hash.c) */
+    DIGRAM_SLOT *digram_table;       // The digram hash table
+    int digram_bits;                 // Size of the table, as a power of two
+    uint64_t digram_generation;      // Current generation of the table
+    int digram_count;                // Number of digrams in the current generation
+
+    /* Grammar of the block being decompressed (comdec.c) */
+    uint32_t *grammar;               // Rules of the block, one after another
+    size_t grammar_length;           // Number of entries of grammar in use
+    size_t grammar_slots;            // Number of entries grammar has room for
+    int grammar_rules;               // Number of rules in grammar
+    uint32_t *rule_offsets;          // Where each rule is in grammar, indexed by its value
+    int rule_offsets_low;            // Range of rule_offsets that may be in use
+    int rule_offsets_high;
+
+    /* Expansion of rules (comdec.c) */
+    size_t *expand_stack;            // Rules being expanded, with where to resume in each
+    int expand_slots;                // Number of entries expand_stack has room for
+    struct expansion *expansions;    // Where the expansion of each rule is in the arena
+    int expansion_slots;             // Number of entries expansions has room for
+    unsigned char *arena;            // Expansions of the rules of a block, one after another
+    size_t arena_size;               // Size of arena
+    size_t materialize_max;          // Largest arena to be used; 0 to always walk the grammar
+} SEQ_CONTEXT;
+
+/*
+ * When it decompresses a block, the engine expands each rule once into an arena and
+ * then copies the expansion wherever the rule is used, as long as the arena for the
+ * block takes no more than the materialize_max bytes of the context.  This is its
+ * initial value; a larger block, or a context with materialize_max set to 0, has its
+ * grammar walked symbol by symbol instead.
+ */
+#ifndef MATERIALIZE_MAX
+#define MATERIALIZE_MAX (64 << 20)
+#endif
+
+/* The current context of the calling thread (definition is in context.c). */
+extern _Thread_local SEQ_CONTEXT *seq_context;
+
+SEQ_CONTEXT *new_context(void);
+void free_context(SEQ_CONTEXT *ctx);
+SEQ_CONTEXT *use_context(SEQ_CONTEXT *ctx);
+int context_compress(SEQ_CONTEXT *ctx, FILE *in, FILE *out, int bsize);
+int context_decompress(SEQ_CONTEXT *ctx, FILE *in, FILE *out);
+
+/*
+ * The state shared between the modules of the engine, as fields of the current context.
+ * State private to a module is mapped the same way in that module.  (context.c, which
+ * works on the fields of contexts other than the current one, does without these.)
+ */
+#ifndef SEQ_CONTEXT_FIELDS
+#define symbol_chunks (seq_context->symbol_chunks)
+#define num_symbols (seq_context->num_symbols)
+#define next_nonterminal_value (seq_context->next_nonterminal_value)
+#define main_rule (seq_context->main_rule)
+#define rule_data (seq_context->rule_data)
+#define rule_generation (seq_context->rule_generation)
+#define digram_table (seq_context->digram_table)
+#define digram_bits (seq_context->digram_bits)
+#define digram_generation (seq_context->digram_generation)
+#endif
+
+/*
+ * OUTPUT
+ *
+ * Both the compressor and the decompressor produce their output a byte or a few
+ * bytes at a time.  Rather than handing each byte to stdio, they put it in an
+ * OUTBUF, which collects the bytes in a large buffer and passes them on a buffer
+ * at a time.  An OUTBUF either writes its buffer to a stream whenever it fills up
+ * (with write(2) directly, if the stream has a file descriptor), or, if it has no
+ * stream, keeps growing the buffer so that all of the output is collected in memory.
+ * Bytes are counted as the buffer is written out, not one by one.
+ *
+ * When compiled with OUTBUF_VMSPLICE and the stream is a pipe, full buffers are
+ * not copied into the pipe but handed to it with vmsplice(2).  The pipe refers to
+ * the pages of the buffer from then on, and a reader that splices them out of the
+ * pipe keeps referring to them for as long as it likes, so the OUTBUF drops the
+ * pages and fills the buffer again in fresh ones rather than writing over them.
+ * Getting fresh pages costs about as much as the copy that write(2) makes, so this
+ * is not done by default.
+ */
+
+/* Reads or writes queued on an io_uring (see uring.c). */
+typedef struct uring URING;
+
+/* Size of the buffer of an OUTBUF that writes to a stream. */
+#define OUTBUF_SIZE (256 << 10)
+
+/* Capacity asked for a pipe that an OUTBUF writes to. */
+#define OUTBUF_PIPE_SIZE (1 << 20)
+
+typedef struct outbuf {
+    unsigned char *data;       // The buffer
+    size_t length;             // Number of bytes in the buffer
+    size_t capacity;           // Size of the buffer
+    FILE *stream;              // Stream written to, or NULL to collect output in memory
+    int fd;                    // File descriptor of the stream, or -1 to use fwrite()
+    long total;                // Number of bytes written out of the buffer so far
+    unsigned char *pages;      // Pages of a buffer handed to a pipe, or NULL
+    URING *uring;              // Writes in flight, or NULL
+} OUTBUF;
+
+int outbuf_open(OUTBUF *ob, FILE *stream);
+int outbuf_flush(OUTBUF *ob);
+int outbuf_write(OUTBUF *ob, unsigned char *data, size_t length);
+int outbuf_close(OUTBUF *ob);
+
+/**
+ * Puts a byte in an OUTBUF, writing out the buffer first if it is full.
+ *
+ * @return  The byte, or EOF if the buffer could not be written out.
+ */
+static inline int outbuf_putc(OUTBUF *ob, int c) {
+    if(ob->length == ob->capacity && outbuf_flush(ob)) {
+        return EOF;
+    }
+    *(ob->data + ob->length++) = c;
+    return c;
+}
+
+/*
+ * INPUT
+ *
+ * The decompressor reads its input through an INBUF, which holds a buffer of
+ * bytes from a stream, or a transmission or a block that is already in memory.
+ * When the stream is a regular file, the INBUF maps the file into memory instead
+ * of reading it, so the bytes are decoded where they lie in the page cache.
+ * Symbols are decoded straight out of the buffer; the buffer is refilled only
+ * when fewer than INBUF_LOOKAHEAD bytes are left in it, which is enough for the
+ * longest symbol, so a symbol never has to be put together across two reads.
+ */
+
+/* Size of the buffer of an INBUF that reads from a stream. */
+#define INBUF_SIZE (64 << 10)
+
+/* Number of bytes that inbuf_fill() makes available, unless the input runs out. */
+#define INBUF_LOOKAHEAD 4
+
+typedef struct inbuf {
+    unsigned char *data;       // The buffer
+    unsigned char *next;       // Next byte to be read
+    unsigned char *end;        // End of the bytes in the buffer
+    size_t capacity;           // Size of the buffer, or 0 if the INBUF does not own it
+    FILE *stream;              // Stream read from, or NULL once there is nothing more to read
+    FILE *mapped;              // Stream whose file is mapped at data, or NULL
+    size_t mapped_length;      // Length of the mapping
+    URING *uring;              // Reads in flight, or NULL
+} INBUF;
+
+int inbuf_open(INBUF *ib, FILE *stream);
+int inbuf_map(INBUF *ib, FILE *stream);
+void inbuf_memory(INBUF *ib, unsigned char *data, size_t length);
+size_t inbuf_fill(INBUF *ib);
+void inbuf_close(INBUF *ib);
+
+size_t uring_fill(INBUF *ib);
+int uring_flush(OUTBUF *ob);
+int uring_drain(URING *ur);
+
+/**
+ * Gets the next byte from an INBUF, refilling the buffer first if it is empty.
+ *
+ * @return  The byte, or EOF if there is no more input.
+ */
+static inline int inbuf_getc(INBUF *ib) {
+    if(ib->next == ib->end && inbuf_fill(ib) == 0) {
+        return EOF;
+    }
+    return *ib->next++;
+}
+
 #endif
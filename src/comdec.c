@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "const.h"
 #include "sequitur.h"
 #include "debug.h"
@@ -11,30 +13,36 @@ int isEOT(int b);
 int isSOB(int b);
 int isEOB(int b);
 int isRD(int b);
-int isNonterminalStart(int byte);
-int getNextNonterminalByte(FILE *in, FILE *out);
-int makeNonterminalNext(int span, int prevbyte, FILE *in, FILE *out);
-int isTerminalSingle(int byte);
-int isTerminalDouble(int byte);
-int getNextTerminalByte(FILE *in, FILE *out);
-int makeTerminalNext(int prevbyte, FILE *in, FILE *out);
-int getUTF1(int num);
-int getUTF2(int num);
-int getUTF3(int num);
-int getUTF4(int num);
-int readRuleData(FILE *in, FILE *out);
-int readBlockData(FILE *in, FILE *out);
-int mapBodyRules(SYMBOL *head, FILE *in, FILE *out);
-
-int determineUTFByteSize(int value);
-int convertToUTF(int value, int bytesize, FILE *out);
+int readSymbol(INBUF *in, int *value);
+int readRuleData(INBUF *in);
+int readBlockData(INBUF *in);
+int init_grammar(void);
+int grammarAppend(uint32_t value);
+int mapBodyRules(OUTBUF *out);
+int expandPush(int depth, size_t rule, size_t pos);
+int walkRules(OUTBUF *out);
+int materializeRules(OUTBUF *out);
+
+unsigned char *encodeSymbol(unsigned char *p, int value);
 
 SYMBOL *compressInitBlockFunctions();
-int compressBlockRules(int byte, SYMBOL *head, FILE *in);
-int compressWriteRuleBody(SYMBOL *rule, FILE *out);
+int compressReserve(int bsize);
+int compressWindow(unsigned char *data, size_t length, OUTBUF *out);
+int compressToMemory(unsigned char *data, size_t length, unsigned char **blocks, size_t *size);
+int compressWriteBlock(SYMBOL *head, OUTBUF *out);
+size_t compressBlockBytes(SYMBOL *head, unsigned char *bytes, size_t count);
+int compressWriteRuleBody(SYMBOL *rule, OUTBUF *out);
+void digram_report(void);
+
+/*
+ * Nonterminal values kept in hand while compressing a block.  Adding one byte
+ * to a block only ever creates a few rules, so a block is ended early once
+ * fewer values than this are left.
+ */
+#define RULE_VALUES_RESERVE 1024
 
-int writeouts = 0;
-int compressedbytes = 0;
+/* The largest number of bytes that the UTF-8 encoding of a symbol takes. */
+#define UTF_BYTES_MAX 4
 
 /*
  * You may modify this file and/or move the functions contained here
@@ -57,6 +65,9 @@ int compressedbytes = 0;
  * "bsize" bytes of uncompressed data and the last compressed block represents
  * at most "bsize" bytes.
  *
+ * If the input is a regular file, it is mapped into memory and each block is
+ * compressed straight from the mapping; otherwise it is read a block at a time.
+ *
  * @param in  The stream from which input is to be read.
  * @param out  The stream to which the block is to be written.
  * @param bsize  The maximum number of bytes read per block.
@@ -64,122 +75,193 @@ int compressedbytes = 0;
  * otherwise EOF.
  */
 int compress(FILE *in, FILE *out, int bsize) {
-    int compret = 0;
-    compressedbytes = 0; // Number of bytes written out
-    int byte = fgetc(in);  // Changed from char to int to properly handle EOF
-
-    int puttedc = fputc(0x81, out); // SOT
-    compressedbytes++;
-    if(puttedc == EOF) {
+    if(compressReserve(bsize)) {
         return EOF;
     }
 
-    while(byte != EOF) {
-        debug("Reading byte: %c (0x%x)", byte, byte);
-        SYMBOL *head = compressInitBlockFunctions();
+    INBUF ib;
+    int mapped = inbuf_map(&ib, in) == 0;
+    // Otherwise, input is read a whole block at a time into this buffer.
+    unsigned char *buffer = mapped ? NULL : malloc(bsize);
+    OUTBUF ob;
+    int ret = outbuf_open(&ob, out);
+    if(!mapped && buffer == NULL) {
+        ret = EOF;
+    }
 
-        // Loop for reading text file of blocksize
-        int bsizeCounter = 0;
-        int kilobsize = bsize * 1024;
-        while(bsizeCounter < kilobsize) {
-            int cbrRet = compressBlockRules(byte, head, in);
-            if(!cbrRet) { // Break out of the loop when the byte is EOF
-                break;
-            }
-            bsizeCounter++;
-            byte = fgetc(in);
-            if(byte == EOF) {
-                break;
+    if(ret != EOF) {
+        ret = outbuf_putc(&ob, 0x81); // SOT
+    }
+    size_t length;
+    if(mapped) {
+        while(ret != EOF && (length = ib.end - ib.next) > 0) {
+            if(length > (size_t)bsize) {
+                length = bsize;
             }
-            debug("Got byte: %d", byte);
-            debug("bsizeCounter: %d", bsizeCounter);
+            debug("Mapped block of %zu bytes", length);
+            ret = compressWindow(ib.next, length, &ob);
+            ib.next += length;
         }
+        inbuf_close(&ib);
+    }
+    while(!mapped && ret != EOF && (length = fread(buffer, 1, bsize, in)) > 0) {
+        debug("Read block of %zu bytes", length);
+        ret = compressWindow(buffer, length, &ob);
+    }
+    if(ret != EOF) {
+        ret = outbuf_putc(&ob, 0x82); // EOT
+    }
+    free(buffer);
 
-        puttedc = fputc(0x83, out); // SOB
-        compressedbytes++;
-        if(puttedc == EOF) {
-            return EOF;
-        }
+    if(outbuf_close(&ob) == EOF || ret == EOF) {
+        return EOF;
+    }
+    fflush(out);
+    return ob.total > INT_MAX ? EOF : ob.total;
+}
 
+/**
+ * Reserves symbol storage and the digram table of the current context for
+ * compressing blocks of bsize bytes.  The digram table grows as needed, so it
+ * starts out no larger than for a 1MB block.
+ *
+ * @param bsize  The maximum number of bytes per block.
+ * @return 0 if successful, otherwise -1.
+ */
+int compressReserve(int bsize) {
+    if(bsize < 1 || BLOCK_SYMBOLS((long)bsize) > INT_MAX) {
+        return -1;
+    }
+    if(reserve_symbols(BLOCK_SYMBOLS(bsize))
+       || reserve_digrams(bsize < MAX_SYMBOLS ? bsize : MAX_SYMBOLS)) {
+        return -1;
+    }
+    return 0;
+}
 
-        SYMBOL *ruleptr = head;
-        do { // Loop to write output file with existing rules
-            compret = compressWriteRuleBody(ruleptr, out);
-            if(!compret) {
-                return EOF;
-            }
-            ruleptr = ruleptr->nextr;
-            if(ruleptr != head) { // RD
-                puttedc = fputc(0x85, out);
-                compressedbytes++;
-                if(puttedc == EOF) {
-                    return EOF;
-                }
-            }
-        } while(ruleptr != head);
+/**
+ * Compresses a window of input, which holds at most bsize bytes, and writes out
+ * the resulting blocks.  A window is normally a single block, but a very large
+ * one can run out of nonterminal values; if so, the rest of the window starts a
+ * new block instead.  Windows therefore always begin at multiples of bsize in the
+ * input, so each one can be compressed without knowing anything about those
+ * before it.
+ *
+ * @param data  The bytes of the window.
+ * @param length  The number of bytes in the window.
+ * @param out  The buffer to which the blocks are written.
+ * @return 0 if successful, otherwise EOF.
+ */
+int compressWindow(unsigned char *data, size_t length, OUTBUF *out) {
+    size_t done = 0;
+    do {
+        SYMBOL *head = compressInitBlockFunctions();
+        done += compressBlockBytes(head, data + done, length - done);
+        digram_report();
 
-        puttedc = fputc(0x84, out); // EOB
-        compressedbytes++;
-        if(puttedc == EOF) {
+        if(!compressWriteBlock(head, out)) {
             return EOF;
         }
-    }
-    puttedc = fputc(0x82, out); // EOT
-    compressedbytes++;
-    if(puttedc == EOF) {
+    } while(done < length);
+    return 0;
+}
+
+/**
+ * Compresses a window of input, as compressWindow() does, into blocks collected
+ * in memory.  Symbol storage and the digram table must have been reserved.
+ *
+ * @param data  The bytes of the window.
+ * @param length  The number of bytes in the window.
+ * @param blocks  Set to the blocks, which the caller frees, even on failure.
+ * @param size  Set to the number of bytes of blocks.
+ * @return 0 if successful, otherwise EOF.
+ */
+int compressToMemory(unsigned char *data, size_t length, unsigned char **blocks, size_t *size) {
+    OUTBUF out;
+    if(outbuf_open(&out, NULL) == EOF) {
         return EOF;
     }
-
-    fflush(out);
-    return compressedbytes;
+    int ret = compressWindow(data, length, &out);
+    outbuf_close(&out);
+    *blocks = out.data;
+    *size = out.length;
+    return ret;
 }
 
-
 /**
- * Writes out the rule body to FILE out
+ * Writes out a block, from SOB to EOB, containing the rules in the list headed
+ * by the given main rule.
  *
  * @return 0 if fail write, 1 if success
  */
-int compressWriteRuleBody(SYMBOL *rule, FILE *out) {
-    debug("compressWriteRuleBody value of rule: %d", rule->value);
-    SYMBOL *symptr = rule;
-    int value = rule->value;
-    int bytesize = determineUTFByteSize(value);
-    int convtoUTF = convertToUTF(value, bytesize, out);
-    if(!convtoUTF) {
+int compressWriteBlock(SYMBOL *head, OUTBUF *out) {
+    if(outbuf_putc(out, 0x83) == EOF) { // SOB
         return 0;
     }
-    symptr = symptr->next;
-    while(symptr != rule) {
-        value = symptr->value;
-        bytesize = determineUTFByteSize(value);
-        convtoUTF = convertToUTF(value, bytesize, out);
-        if(!convtoUTF) {
+
+    SYMBOL *ruleptr = head;
+    do { // Loop to write output file with existing rules
+        if(!compressWriteRuleBody(ruleptr, out)) {
+            return 0;
+        }
+        ruleptr = NEXTR(ruleptr);
+        if(ruleptr != head && outbuf_putc(out, 0x85) == EOF) { // RD
             return 0;
         }
-        symptr = symptr->next;
+    } while(ruleptr != head);
+
+    if(outbuf_putc(out, 0x84) == EOF) { // EOB
+        return 0;
     }
     return 1;
 }
 
 
 /**
- * Processes the inner body of the while loop for each block
+ * Writes out the rule body to OUTBUF out.
+ * Symbols are encoded straight into the buffer of the OUTBUF, as many at a time
+ * as there is certainly room for, and the buffer is only checked between runs.
  *
- * @return 1 If successfully completed the inner functions
- * @return 0 If the
+ * @return 0 if fail write, 1 if success
  */
-int compressBlockRules(int byte, SYMBOL *head, FILE *in) {
-    if(byte == EOF) {
-        return 0;
-    }
+int compressWriteRuleBody(SYMBOL *rule, OUTBUF *out) {
+    debug("compressWriteRuleBody value of rule: %d", rule->value);
+    SYMBOL *symptr = rule;
+    do {
+        if(out->capacity - out->length < UTF_BYTES_MAX && outbuf_flush(out)) {
+            return 0;
+        }
+        unsigned char *p = out->data + out->length;
+        unsigned char *limit = out->data + out->capacity - UTF_BYTES_MAX;
+        do {
+            p = encodeSymbol(p, symptr->value);
+            symptr = NEXT(symptr);
+        } while(symptr != rule && p <= limit);
+        out->length = p - out->data;
+    } while(symptr != rule);
+    return 1;
+}
 
-    byte = byte & 0xFF;
 
-    SYMBOL *sym = new_symbol(byte, NULL);
-    insert_after(head->prev, sym);
-    check_digram(sym->prev);
-    return 1;
+/**
+ * Feeds bytes of input to the Sequitur algorithm, appending them one after another
+ * to the main rule of the block that is being compressed.  Stops early if the
+ * block is about to run out of nonterminal values.
+ *
+ * @param head  The main rule of the block.
+ * @param bytes  The bytes to be appended.
+ * @param count  The number of bytes.
+ * @return The number of bytes appended.
+ */
+size_t compressBlockBytes(SYMBOL *head, unsigned char *bytes, size_t count) {
+    unsigned char *end = bytes + count;
+    unsigned char *p = bytes;
+    while(p < end && rule_values_left() >= RULE_VALUES_RESERVE) {
+        SYMBOL *sym = new_symbol(*p++, NULL);
+        insert_after(PREV(head), sym);
+        check_digram(PREV(sym));
+    }
+    return p - bytes;
 }
 
 /**
@@ -191,138 +273,44 @@ SYMBOL *compressInitBlockFunctions() {
     init_symbols();
     init_rules();
     init_digram_hash();
-    SYMBOL *head = new_rule(next_nonterminal_value);
-    next_nonterminal_value++;
+    SYMBOL *head = new_rule(new_rule_value());
     add_rule(head);
     return head;
 }
 
-/**
- * Given a value, convert the value to bytes in UTF and fputc it
- *
- * @return 0 fail file write, 1 for success file write
+/*
+ * Tables for encoding symbols in UTF-8.  utf_lengths gives the number of bytes
+ * for a value from the number of bits that it needs (up to 21), and utf_prefixes
+ * gives the bits that mark the first byte of a value of a given number of bytes.
  */
-int convertToUTF(int value, int bytesize, FILE *out) {
-    debug("convertToUTF");
-    int puttedc;
-    if(bytesize == 1) {
-        puttedc = fputc(value, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        compressedbytes += 1;
-        return 1;
-    }
-    else if(bytesize == 2) {
-        int utfmask1 = 0b11000000;  
-        int utfmask2 = 0b10000000; 
-        int mask1 = 0b11111;       
-        int mask2 = 0b111111;      
-        int byte1 = (value >> 6) & mask1; 
-        int byte2 = value & mask2;     
-
-        byte1 |= utfmask1;  
-        byte2 |= utfmask2; 
-
-        puttedc = fputc(byte1, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte2, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        compressedbytes += 2;
-        return 1;
-    }
-    else if(bytesize == 3) {
-        int utfmask1 = 0b11100000;  
-        int utfmask2 = 0b10000000;  
-        int mask1 = 0b1111;        
-        int mask2 = 0b111111;      
-        int mask3 = 0b111111;      
-        int byte1 = (value >> 12) & mask1; 
-        int byte2 = (value >> 6) & mask2; 
-        int byte3 = value & mask3;        
-    
-        byte1 |= utfmask1;  
-        byte2 |= utfmask2; 
-        byte3 |= utfmask2;  
-    
-        puttedc = fputc(byte1, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte2, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte3, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        compressedbytes += 3;
-        return 1;
-    }
-    else if(bytesize == 4) {
-        int utfmask1 = 0b11110000; 
-        int utfmask2 = 0b10000000; 
-        int mask1 = 0b111;          
-        int mask2 = 0b111111;      
-        int mask3 = 0b111111;       
-        int mask4 = 0b111111;       
-        int byte1 = (value >> 18) & mask1; 
-        int byte2 = (value >> 12) & mask2; 
-        int byte3 = (value >> 6) & mask3; 
-        int byte4 = value & mask4;         
-    
-        byte1 |= utfmask1;  
-        byte2 |= utfmask2;  
-        byte3 |= utfmask2;  
-        byte4 |= utfmask2;  
-    
-        puttedc = fputc(byte1, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte2, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte3, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        puttedc = fputc(byte4, out);
-        if(puttedc == EOF) {
-            return 0;
-        }
-        compressedbytes += 4;
-        return 1;
-    }
-    else {
-        debug("Invalid convert.");
-        return 0;
-    }
-}
+static const unsigned char *const utf_lengths = (const unsigned char *)
+    "\1\1\1\1\1\1\1\1"       // 0-7 bits
+    "\2\2\2\2"                   // 8-11 bits
+    "\3\3\3\3\3"                 // 12-16 bits
+    "\4\4\4\4\4";                // 17-21 bits
+
+static const unsigned char *const utf_prefixes = (const unsigned char *)"\x00\x00\xc0\xe0\xf0";
+
 /**
- * Given a value, determine the length of the UTF value in bytes
+ * Encodes the value of a symbol in UTF-8.
+ *
+ * @param p  Where the bytes are to be put; there must be room for UTF_BYTES_MAX.
+ * @param value  The value, which is at most LAST_NONTERMINAL.
+ * @return  The address just after the bytes that were put.
  */
-int determineUTFByteSize(int value) {
-    if(value <= 0x7f) {
-        return 1;
-    }
-    else if(value <= 0x7ff) {
-        return 2;
+unsigned char *encodeSymbol(unsigned char *p, int value) {
+    if(value < 0x80) {
+        *p++ = value;
+        return p;
     }
-    else if(value < 0xffff) {
-        return 3;
+    int length = *(utf_lengths + 32 - __builtin_clz(value));
+    int shift = 6 * (length - 1);
+    *p++ = *(utf_prefixes + length) | (value >> shift);
+    while(shift > 0) {
+        shift -= 6;
+        *p++ = 0x80 | ((value >> shift) & 0x3f);
     }
-    else if(value < 0x10ffff) {
-        return 4;
-    }
-    debug("Invalid return.");
-    return 0;
+    return p;
 }
 
 /**
@@ -336,424 +324,600 @@ int determineUTFByteSize(int value) {
  * @return  The number of bytes written, in case of success, otherwise EOF.
  */
 int decompress(FILE *in, FILE *out) {
-    writeouts = 0;
-    init_symbols();
-    init_rules();
+    // Include helpers
+    int decompressBlocks(INBUF *ib, OUTBUF *ob);
+
+    // The output of the blocks decompressed before any error is still written out.
+    INBUF ib;
+    if(inbuf_open(&ib, in) == EOF) {
+        return EOF;
+    }
+    OUTBUF ob;
+    int ret = outbuf_open(&ob, out);
+    if(ret != EOF) {
+        ret = decompressBlocks(&ib, &ob);
+    }
+    inbuf_close(&ib);
+    if(outbuf_close(&ob) == EOF || ret == EOF) {
+        return EOF;
+    }
+    fflush(out);
+    return ob.total > INT_MAX ? EOF : ob.total;
+}
+
+/**
+ * Reads a transmission, from SOT to EOT, and expands its blocks.
+ *
+ * @param ib  The buffer through which the transmission is read.
+ * @param ob  The buffer through which the uncompressed data is written.
+ * @return 0 if successful, otherwise EOF.
+ */
+int decompressBlocks(INBUF *ib, OUTBUF *ob) {
     int byte;
     int rbdflag;
     int ret;
 
     // Start of transmission
-    byte = fgetc(in);
+    byte = inbuf_getc(ib);
     if(!isSOT(byte)) {
         return EOF;
     }
 
     // Parse blocks, check using isSOB
-    byte = fgetc(in);
+    byte = inbuf_getc(ib);
     while(isSOB(byte)) {
-        rbdflag = readBlockData(in, out);
+        if(init_grammar()) {
+            return EOF;
+        }
+        rbdflag = readBlockData(ib);
         if(!rbdflag) {
             return EOF;
         }
 
-        ret = mapBodyRules(main_rule, in, out);
+        ret = mapBodyRules(ob);
         if(!ret) {
             return EOF;
         }
 
-        init_symbols();
-        init_rules();
-        byte = fgetc(in);
+        byte = inbuf_getc(ib);
     }
 
     // End of transmission
     if(!isEOT(byte)) {
         return EOF;
     }
-    byte = fgetc(in);
+    byte = inbuf_getc(ib);
     if(byte != EOF) {
         return EOF;
     }
-
-    fflush(out);
-
-    return writeouts;
+    return 0;
 }
 
-
 /**
- * Maps the body symbol's rule variable the rules in the rule_map.
- * After this, expansion will happen
+ * Scans the bytes of a block for its EOB.
  *
- * @precondition The link list of all rules, along with their body. The
- * rule_map is also made and should contain the rules of this block.
- * @return 0 on fail, 1 on success
- */
-int mapBodyRules(SYMBOL *head, FILE *in, FILE *out) {
-    int max = (1 << 21);
-    int ret = 0;
-    SYMBOL *ptr = (*head).next;
-    while(ptr != head) {
-        if((*ptr).value < FIRST_NONTERMINAL) {
-            writeouts++;
-            int puttedc = 0;
-            puttedc = fputc((*ptr).value, out);
-            if(puttedc == EOF) {
-                return 0;
-            }
-            compressedbytes++;
-            ptr = (*ptr).next;
-        }
-        else if((*ptr).value > max) {
-            return 0;
-        }
-        else if(*(rule_map + (*ptr).value) == NULL) {
-            return 0;
-        }
-        else {
-            SYMBOL *nonterm = NULL;
-            nonterm = (*ptr).rule;
-            nonterm = *(rule_map + ((*ptr).value));
-            ret = mapBodyRules(nonterm, in, out);
-            if(!ret) {
-                return 0;
-            }
-            ptr = (*ptr).next;
-        }
-    }
-    return 1;
-}
-
-/**
- * Reads the block of data and parses it
+ * Marker bytes are UTF-8 continuation bytes, so a byte with the value of EOB can
+ * also occur inside a multi-byte symbol.  The scan therefore follows the encoding:
+ * the first byte of each symbol gives the number of continuation bytes that
+ * follow it, and only a continuation byte in the place of the first byte of a
+ * symbol is a marker.  The scan does not check the encoding any further.  If a
+ * block is malformed, parsing it fails at the same point that decompress() would
+ * fail, which lies in the bytes that the scan gave to the block.
  *
- * @return 1 on successful parse
- * 0 on unsuccessful parse
- */
-int readBlockData(FILE *in, FILE *out) {
-    debug("reached readBlockData");
-    int rrdflag = 0x85;
-    while(isRD(rrdflag)) {
-        rrdflag = readRuleData(in, out);
-    }
-
-    if(isEOB(rrdflag)) {
-        return 1;
-    }
-    return 0;
-}
-
-/**
- * Reads and checks the single rule in the block after the SOB or RD
+ * A block may be scanned a piece at a time, as long as *pending is carried over
+ * from one piece to the next; it is 0 at the start of a block.
  *
- * @return EOB or RD if sucussful, 0 if unsuccessful
+ * @param p  The first byte to scan.
+ * @param end  Just after the last byte to scan.
+ * @param pending  The number of continuation bytes still to come in the current
+ * symbol, which is updated.
+ * @return  Just after the EOB, or NULL if there is no EOB before end.
  */
-int readRuleData(FILE *in, FILE *out) {
-    debug("reached readRuleData");
-    void add_body(SYMBOL *bodysym, SYMBOL *rule);
-    SYMBOL *head;
-    int byte;
-    int symval = 0;
-    int symcount = 0; // Return 0 if this is less than 3
-    int nonterminalspan = 0;
-    int terminalspan = 0;
-
-    // Valid rule head
-    byte = fgetc(in);
-    nonterminalspan = isNonterminalStart(byte);
-    symval = makeNonterminalNext(nonterminalspan, byte, in, out);
-    if(!(nonterminalspan && symval)) {
-        return 0;
-    }
-    head = new_rule(symval); // make the symbol of the rule head
-    add_rule(head);
-    symcount++;
-
-    // Make rule body
-    // TODO: Make debug print statements of conditional body and value calculated
-    while(1) {
-        byte = fgetc(in);
-        if(isMarker(byte)) {
-            debug("Reached isMarker() in readRuleData()\n");
-            if(symcount < 3 || !isValidMarker(byte)) {
-                return 0;
-            }
-            else if(isEOB(byte) || isRD(byte)) {
-                break;
-            }
-            else {
-                return 0; // Guaranteed return
-            }
+unsigned char *scanForEOB(unsigned char *p, unsigned char *end, int *pending) {
+    int n = *pending;
+    while(p < end) {
+        int b = *p++;
+        if(n) {
+            n--;
         }
-        else if((nonterminalspan = isNonterminalStart(byte))) {
-            symval = makeNonterminalNext(nonterminalspan, byte, in, out);
-            if(!symval) {
-                return 0;
-            }
-            SYMBOL *body = new_symbol(symval, NULL);
-            add_body(body, head);
-            symcount++;
-            // debug("Created a nonterminal value: %d", symval);
+        else if(b >= 0xF0) {
+            n = 3;
         }
-        else if((terminalspan = isTerminalDouble(byte))) {
-            symval = makeTerminalNext(byte, in, out);
-            if(!symval) {
-                return 0;
-            }
-            SYMBOL *body = new_symbol(symval, NULL);
-            add_body(body, head);
-            symcount++;
-            // debug("Created a terminal 2 byte value: %d", symval);
+        else if(b >= 0xE0) {
+            n = 2;
         }
-        else if(isTerminalSingle(byte)) {
-            SYMBOL *body = new_symbol(byte, NULL);
-            add_body(body, head);
-            symcount++;
-            // debug("Created a terminal 1 byte value: %d", byte);
+        else if(b >= 0xC0) {
+            n = 1;
         }
-        else {
-            // debug("Else case in readRuleData()");
-            return 0;
+        else if(b == 0x84) { // EOB
+            *pending = 0;
+            return p;
         }
     }
-
-    // Add to rule to rule_map
-    int offset = (*head).value;
-    *(rule_map + offset) = head;
-
-    if(isEOB(byte) || isRD(byte)) {
-        return byte;
-    }
-    return 0;
+    *pending = n;
+    return NULL;
 }
 
-/**
- * Gets the value of a 1 byte utf for the sake of being complete
- */
-int getUTF1(int num) {
-    int mask0 = 0b01111111;
-    int byte0 = mask0 & num;
-    int word = byte0;
-    return word;
-}
 
-/**
- * Gets the value of a 2 byte utf
+/*
+ * The grammar of a block, as the decompressor holds it.  The decompressor never
+ * changes a grammar once it has been read, so rather than linking SYMBOLs together
+ * it puts the rules one after another in the array grammar.  Each rule takes up
+ * GRAMMAR_HEADER entries, of which the first is the number of symbols in its body,
+ * followed by the values of the symbols of the body.  The first rule of a block is
+ * its main rule.  rule_offsets, indexed by the value of the head of a rule, holds
+ * one more than the position of the rule in grammar, or 0 if there is no rule with
+ * that value.
  */
+#define grammar (seq_context->grammar)
+#define grammar_length (seq_context->grammar_length)
+#define grammar_slots (seq_context->grammar_slots)
+#define grammar_rules (seq_context->grammar_rules)
+#define rule_offsets (seq_context->rule_offsets)
+#define rule_offsets_low (seq_context->rule_offsets_low)
+#define rule_offsets_high (seq_context->rule_offsets_high)
+
+#define GRAMMAR_HEADER 2
+#define RULE_LENGTH(r) (*(grammar + (r)))
+#define RULE_MARK(r) (*(grammar + (r) + 1))
+#define RULE_BODY(r) ((r) + GRAMMAR_HEADER)
+#define RULE_END(r) (RULE_BODY(r) + RULE_LENGTH(r))
 
- int getUTF2(int num) {
-    int mask0 = 0b00111111;
-    int mask1 = 0b00011111;
-    int byte0 = num & mask0;
-    int byte1 = (num >> 8) & mask1;
-    byte1 = byte1 << 6;
-
-    int word = byte0 | byte1;
-    return word;
-}
-
-/**
- * Gets the value of a 3-byte UTF
+/*
+ * Stack of the rules that are in the middle of being expanded.  For each one, it
+ * holds the position of the rule in grammar and the position in its body at which
+ * to carry on once the nonterminal being expanded is done.
  */
-int getUTF3(int num) {
-    int mask0 = 0b00111111;  
-    int mask1 = 0b00111111; 
-    int mask2 = 0b00001111;  
-    int byte0 = num & mask0;
-    int byte1 = (num >> 8) & mask1;
-    int byte2 = (num >> 16) & mask2;
-    byte1 = byte1 << 6;
-    byte2 = byte2 << 12;
-
-    int word = byte0 | byte1 | byte2;
-    return word;
-}
+#define expand_stack (seq_context->expand_stack)
+#define expand_slots (seq_context->expand_slots)
 
-/**
- * Gets the value of a 4-byte UTF
+/*
+ * Expansions of rules, which materializeRules() puts one after another in the
+ * arena.  Each rule that has been expanded has the number of its entry in
+ * expansions, plus one, in its RULE_MARK; EXPANDING marks a rule whose expansion
+ * is not done yet.
  */
-int getUTF4(int num) {
-    int mask0 = 0b00111111;
-    int mask1 = 0b00111111; 
-    int mask2 = 0b00111111;  
-    int mask3 = 0b00000111;  
-    int byte0 = num & mask0;
-    int byte1 = (num >> 8) & mask1;
-    int byte2 = (num >> 16) & mask2;
-    int byte3 = (num >> 24) & mask3;
-    byte1 = byte1 << 6;
-    byte2 = byte2 << 12;
-    byte3 = byte3 << 18;
-
-    int word = byte0 | byte1 | byte2 | byte3;
-    return word;
-}
+typedef struct expansion {
+    size_t rule;               // Position of the rule in grammar
+    size_t offset;             // Where the expansion starts in the arena
+    size_t length;             // Number of bytes in the expansion
+} EXPANSION;
 
+#define expansions (seq_context->expansions)
+#define expansion_slots (seq_context->expansion_slots)
+#define arena (seq_context->arena)
+#define arena_size (seq_context->arena_size)
+#define materialize_max (seq_context->materialize_max)
+
+#define EXPANDING UINT32_MAX
 
 /**
- * Gets the value after utf from utf num and number of utf bytes
+ * Empties the grammar of the current context, ready for the next block.  Only the
+ * part of rule_offsets used since the last time has to be cleared.
  *
- * Return 0 on error
+ * @return 0 if successful, otherwise -1.
  */
-int getUTFs(int num, int span) {
-    if(span == 1) {
-        return getUTF1(num);
-    }
-    else if(span == 2) {
-        return getUTF2(num);
-    }
-    else if(span == 3) {
-        return getUTF3(num);
-    }
-    else if(span == 4) {
-        return getUTF4(num);
-    }
+int init_grammar(void) {
+    if(rule_offsets == NULL) {
+        rule_offsets = calloc(SYMBOL_VALUE_MAX + 1, sizeof(uint32_t));
+        if(rule_offsets == NULL) {
+            return -1;
+        }
+    }
+    int count = rule_offsets_low;
+    while(count < rule_offsets_high) {
+        *(rule_offsets + count) = 0;
+        count++;
+    }
+    rule_offsets_low = SYMBOL_VALUE_MAX;
+    rule_offsets_high = 0;
+    grammar_length = 0;
+    grammar_rules = 0;
     return 0;
 }
 
 /**
- * Determines if this is a terminal with 2 bytes
+ * Appends an entry to the grammar, making the array larger if need be.
  *
- * @return 1 if this is a 2 byte terminal, 0 if not.
+ * @param value  The entry.
+ * @return 0 if successful, otherwise -1.
  */
-int isTerminalDouble(int byte) {
-    int maskc0 = 0b11000000;
-    int maskc1 = 0b11000001;
-    int maskc2 = 0b11000010;
-    int maskc3 = 0b11000011;
-    if(byte == maskc0 || byte == maskc1 || byte == maskc2 || byte == maskc3) {
-        return 1; // Terminal masks
+int grammarAppend(uint32_t value) {
+    if(grammar_length == grammar_slots) {
+        size_t slots = grammar_slots ? 2 * grammar_slots : 65536;
+        if(slots >= UINT32_MAX) {
+            return -1;
+        }
+        uint32_t *table = realloc(grammar, slots * sizeof(uint32_t));
+        if(table == NULL) {
+            return -1;
+        }
+        grammar = table;
+        grammar_slots = slots;
     }
+    *(grammar + grammar_length++) = value;
     return 0;
 }
 
 /**
- * Makes and interpret the rest of the terminal value based on
- * the previous byte.
+ * Expands the main rule of a block, writing out the terminals that it stands for.
+ * The rules are first expanded into an arena, if their expansions fit, so that a
+ * use of a rule costs a single copy; otherwise, or if the grammar turns out not to
+ * be valid, the grammar is walked instead, which also decides what is wrong with it.
  *
- * @return the terminal symbol value extracted from utf.
- * 0 if failed representation of terminal.
+ * @precondition The grammar of the block has been read by readBlockData().
+ * @param out  The buffer to which the terminals are written.
+ * @return 0 on fail, 1 on success
  */
-int makeTerminalNext(int prevbyte, FILE *in, FILE *out) {
-    int byte = prevbyte << 8;
-    int nextbyte = getNextTerminalByte(in, out);
-    if(!nextbyte) {
-        return 0;
+int mapBodyRules(OUTBUF *out) {
+    int ret = materializeRules(out);
+    if(ret < 0) {
+        ret = walkRules(out);
     }
-    byte = byte | nextbyte; // 110x xxxx 10xx xxxx
-    int value = getUTF2(byte);
-    return value;
+    return ret;
 }
 
 /**
- * Return the next int value of the terminal byte.
+ * Pushes a rule that is being expanded onto expand_stack, making the stack larger
+ * if need be.
  *
- * @return the value of the next terminal byte
- * 0 if invlaid byte
+ * @param depth  The number of rules on the stack.
+ * @param rule  The position of the rule in grammar.
+ * @param pos  The position in its body at which to carry on.
+ * @return 0 if successful, otherwise -1.
  */
-int getNextTerminalByte(FILE *in, FILE *out) {
-    int byte = fgetc(in);
-    int shiftedbyte = byte >> 6;
-    int mask = 0b10;
-    if(mask == shiftedbyte) {
-        return byte;
-    }
+int expandPush(int depth, size_t rule, size_t pos) {
+    if(2 * depth + 2 > expand_slots) {
+        int slots = expand_slots ? 2 * expand_slots : 64;
+        size_t *stack = realloc(expand_stack, slots * sizeof(size_t));
+        if(stack == NULL) {
+            return -1;
+        }
+        expand_stack = stack;
+        expand_slots = slots;
+    }
+    *(expand_stack + 2 * depth) = rule;
+    *(expand_stack + 2 * depth + 1) = pos;
     return 0;
 }
 
 /**
- * Determines if this is a terminal with 1 byte.
- * Make sure to not use this as a span
+ * Expands the main rule of a block by walking the grammar, writing out the
+ * terminals that it stands for.  Nonterminals are followed through rule_offsets,
+ * using expand_stack rather than recursion, so a grammar can be as deeply nested
+ * as it likes.  A rule that is being expanded can never turn up again inside its
+ * own expansion in a valid grammar, so expansion stops as soon as it goes deeper
+ * than there are rules.
  *
- * @return 1 if this is a 1 byte terminal, 0 if not.
+ * @param out  The buffer to which the terminals are written.
+ * @return 0 on fail, 1 on success
  */
-int isTerminalSingle(int byte) {
-    int mask = 0x0;
-    int shiftedbyte = byte >> 7;
-    if(shiftedbyte == mask) {
-        return 1;
+int walkRules(OUTBUF *out) {
+    // Terminals go straight into the buffer, which is only checked when it is full.
+    unsigned char *p = out->data + out->length;
+    unsigned char *limit = out->data + out->capacity;
+    int ret = 1;
+    int depth = 0;
+    size_t rule = 0;
+    size_t pos = RULE_BODY(rule);
+    size_t end = RULE_END(rule);
+    while(1) {
+        if(pos == end) {
+            if(depth == 0) {
+                break;
+            }
+            depth--;
+            rule = *(expand_stack + 2 * depth);
+            pos = *(expand_stack + 2 * depth + 1);
+            end = RULE_END(rule);
+            continue;
+        }
+        uint32_t value = *(grammar + pos++);
+        if(value < FIRST_NONTERMINAL) {
+            if(p == limit) {
+                out->length = p - out->data;
+                if(outbuf_flush(out)) {
+                    return 0;
+                }
+                p = out->data + out->length;
+                limit = out->data + out->capacity;
+            }
+            *p++ = value;
+        }
+        else {
+            uint32_t offset = *(rule_offsets + value);
+            if(offset == 0 || depth + 1 >= grammar_rules) {
+                ret = 0; // Undefined rule, or a rule that contains itself
+                break;
+            }
+            if(expandPush(depth, rule, pos)) {
+                ret = 0;
+                break;
+            }
+            depth++;
+            rule = offset - 1;
+            pos = RULE_BODY(rule);
+            end = RULE_END(rule);
+        }
     }
-    return 0;
+    out->length = p - out->data;
+    return ret;
 }
 
 /**
- * Determines if the byte is the first part of a nonterminal
+ * Expands the main rule of a block by way of an arena, into which every rule that
+ * it uses is expanded exactly once, after the rules that it uses in turn.  Copies
+ * out of the arena then take the place of walking the grammar, both for the rules
+ * that use a rule and for the main rule itself.
  *
- * @param byte The byte read from fgetc();
- * @return The nonterminal span of the number,
- * 0 if not a valid nonterminal start byte, 1 or more for success
+ * @param out  The buffer to which the terminals are written.
+ * @return 1 on success, 0 if the output could not be written, or -1 if nothing
+ * has been written because the grammar is to be walked instead: the arena would
+ * be larger than materialize_max, or the grammar is not valid.
  */
-int isNonterminalStart(int byte) {
-    int shiftedbyte;
-    int maskc0 = 0b11000000;
-    int maskc1 = 0b11000001;
-    int maskc2 = 0b11000010;
-    int maskc3 = 0b11000011;
-    if(byte == maskc0 || byte == maskc1 || byte == maskc2 || byte == maskc3) {
-        return 0; // Terminal masks
+int materializeRules(OUTBUF *out) {
+    if(materialize_max == 0) {
+        return -1;
+    }
+
+    // Find the order in which to expand the rules: each after those that it uses.
+    size_t total = 0;
+    int count = 0;
+    int depth = 0;
+    size_t rule = 0;
+    size_t pos = RULE_BODY(rule);
+    size_t end = RULE_END(rule);
+    RULE_MARK(rule) = EXPANDING;
+    while(1) {
+        if(pos == end) {
+            if(depth == 0) {
+                break;
+            }
+            size_t length = 0;
+            uint32_t *sym = grammar + RULE_BODY(rule);
+            uint32_t *symend = grammar + end;
+            while(sym < symend) {
+                if(*sym < FIRST_NONTERMINAL) {
+                    length++;
+                }
+                else {
+                    length += (expansions + RULE_MARK(*(rule_offsets + *sym) - 1) - 1)->length;
+                }
+                sym++;
+            }
+            if(length > materialize_max - total) {
+                return -1;
+            }
+            if(count == expansion_slots) {
+                int slots = expansion_slots ? 2 * expansion_slots : 256;
+                EXPANSION *table = realloc(expansions, slots * sizeof(EXPANSION));
+                if(table == NULL) {
+                    return -1;
+                }
+                expansions = table;
+                expansion_slots = slots;
+            }
+            EXPANSION *exp = expansions + count;
+            exp->rule = rule;
+            exp->offset = total;
+            exp->length = length;
+            total += length;
+            count++;
+            RULE_MARK(rule) = count;
+
+            depth--;
+            rule = *(expand_stack + 2 * depth);
+            pos = *(expand_stack + 2 * depth + 1);
+            end = RULE_END(rule);
+            continue;
+        }
+        uint32_t value = *(grammar + pos++);
+        if(value >= FIRST_NONTERMINAL) {
+            uint32_t offset = *(rule_offsets + value);
+            if(offset == 0 || RULE_MARK(offset - 1) == EXPANDING) {
+                return -1;
+            }
+            if(RULE_MARK(offset - 1) != 0) {
+                continue;
+            }
+            if(expandPush(depth, rule, pos)) {
+                return -1;
+            }
+            depth++;
+            rule = offset - 1;
+            pos = RULE_BODY(rule);
+            end = RULE_END(rule);
+            RULE_MARK(rule) = EXPANDING;
+        }
+    }
+
+    // Expand the rules into the arena, in that order.
+    if(total > arena_size) {
+        unsigned char *space = malloc(total);
+        if(space == NULL) {
+            return -1;
+        }
+        free(arena);
+        arena = space;
+        arena_size = total;
+    }
+    EXPANSION *exp = expansions;
+    EXPANSION *expend = expansions + count;
+    while(exp < expend) {
+        unsigned char *p = arena + exp->offset;
+        uint32_t *sym = grammar + RULE_BODY(exp->rule);
+        uint32_t *symend = grammar + RULE_END(exp->rule);
+        while(sym < symend) {
+            if(*sym < FIRST_NONTERMINAL) {
+                *p++ = *sym;
+            }
+            else {
+                EXPANSION *used = expansions + RULE_MARK(*(rule_offsets + *sym) - 1) - 1;
+                memcpy(p, arena + used->offset, used->length);
+                p += used->length;
+            }
+            sym++;
+        }
+        exp++;
     }
 
-    shiftedbyte = byte >> 5;
-    int maskspan1 = 0b110;
-    if(shiftedbyte == maskspan1) {
-        return 1;
+    // Write out the main rule.
+    uint32_t *sym = grammar + RULE_BODY(0);
+    uint32_t *symend = grammar + RULE_END(0);
+    while(sym < symend) {
+        if(*sym < FIRST_NONTERMINAL) {
+            if(outbuf_putc(out, *sym) == EOF) {
+                return 0;
+            }
+        }
+        else {
+            EXPANSION *used = expansions + RULE_MARK(*(rule_offsets + *sym) - 1) - 1;
+            if(outbuf_write(out, arena + used->offset, used->length) == EOF) {
+                return 0;
+            }
+        }
+        sym++;
     }
+    return 1;
+}
 
-    shiftedbyte = byte >> 4;
-    int maskspan2 = 0b1110;
-    if(shiftedbyte == maskspan2) {
-        return 2;
+/**
+ * Reads the block of data and parses it
+ *
+ * @return 1 on successful parse
+ * 0 on unsuccessful parse
+ */
+int readBlockData(INBUF *in) {
+    debug("reached readBlockData");
+    int rrdflag = 0x85;
+    while(isRD(rrdflag)) {
+        rrdflag = readRuleData(in);
     }
 
-    shiftedbyte = byte >> 3;
-    int maskspan3 = 0b11110;
-    if(shiftedbyte == maskspan3) {
-        return 3;
+    if(isEOB(rrdflag)) {
+        return 1;
     }
     return 0;
 }
 
+/*
+ * Classes of the bytes of a transmission, for looking up what a byte can start.
+ * The low two bits of a class are the number of continuation bytes (10xx xxxx)
+ * that must follow the byte, and the other bits are one of the kinds below.
+ * A byte of class 0 cannot start anything inside a rule.
+ */
+#define UTF_TERMINAL 0x10      // 0x00-0x7f, or 0xc0-0xc3 and a continuation byte
+#define UTF_NONTERMINAL 0x20   // 0xc4-0xdf, 0xe0-0xef or 0xf0-0xf7, and 1 to 3 more
+#define UTF_END 0x40           // EOB or RD, which end a rule
+#define UTF_SPAN(class) ((class) & 0x3)
+
+static const unsigned char *const utf_classes = (const unsigned char *)
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x00
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x10
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x20
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x30
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x40
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x50
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x60
+    "\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10\x10"   // 0x70
+    "\x00\x00\x00\x00\x40\x40\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"   // 0x80
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"   // 0x90
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"   // 0xa0
+    "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"   // 0xb0
+    "\x11\x11\x11\x11\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21"   // 0xc0
+    "\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21\x21"   // 0xd0
+    "\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22"   // 0xe0
+    "\x23\x23\x23\x23\x23\x23\x23\x23\x00\x00\x00\x00\x00\x00\x00\x00";  // 0xf0
+
 /**
- * Makes and interpret the rest of the nonterminal value based on
- * the nonterminalspan and the previous byte.
+ * Decodes the next symbol, EOB or RD from the buffer of an INBUF.
+ * The first byte gives, through utf_classes, both the kind of what it starts and
+ * the number of continuation bytes to follow, so the value is put together from
+ * the buffer without looking at the byte any further.  A terminal or nonterminal
+ * of more than one byte that comes out as 0 is not valid.
  *
- * @return the value of the full nonterminal.
- * 0 if failed representation of nonterminal.
+ * @param value  Set to the value of the symbol, or to the byte of EOB or RD.
+ * @return  The class of the first byte, or 0 if the input does not continue with
+ * a valid symbol, EOB or RD.
  */
-int makeNonterminalNext(int span, int prevbyte, FILE *in, FILE *out) {
-    int utfspan = span + 1;
-    int shiftamount = 8 * span;
-    int byte = prevbyte << shiftamount;
-
-    while(span > 0) {
-        span--;
-        int nextbyte = getNextNonterminalByte(in, out);
-        if(!nextbyte) {
+int readSymbol(INBUF *in, int *value) {
+    if(in->end - in->next < INBUF_LOOKAHEAD && inbuf_fill(in) == 0) {
+        return 0;
+    }
+    unsigned char *p = in->next;
+    int byte = *p++;
+    int class = *(utf_classes + byte);
+    int span = UTF_SPAN(class);
+    if(span == 0) {
+        in->next = p;
+        *value = byte;
+        return class;
+    }
+    if(span > in->end - p) {
+        return 0;
+    }
+
+    int word = byte & (0x3f >> span);
+    unsigned char *end = p + span;
+    while(p < end) {
+        int nextbyte = *p++;
+        if((nextbyte & 0xc0) != 0x80) {
             return 0;
         }
-        shiftamount = 8 * span;
-        nextbyte = nextbyte << shiftamount;
-        byte = byte | nextbyte;
+        word = (word << 6) | (nextbyte & 0x3f);
     }
-    int value = getUTFs(byte, utfspan);
-    return value;
+    if(word == 0) {
+        return 0;
+    }
+    in->next = p;
+    *value = word;
+    return class;
 }
 
 /**
- * Return the next int value of the nonterminal byte
+ * Reads and checks the single rule in the block after the SOB or RD
  *
- * @return The value of the next nonterminal byte
- * 0 if invalid byte
+ * @return EOB or RD if sucussful, 0 if unsuccessful
  */
-int getNextNonterminalByte(FILE *in, FILE *out) {
-    int byte = fgetc(in);
-    int shiftedbyte = byte >> 6;
-    int mask = 0b10;
-    if(mask == shiftedbyte) {
-        return byte;
+int readRuleData(INBUF *in) {
+    debug("reached readRuleData");
+    int class;
+    int symval = 0;
+    size_t rule = grammar_length;
+
+    // Valid rule head
+    class = readSymbol(in, &symval);
+    if(!(class & UTF_NONTERMINAL)) {
+        return 0;
+    }
+    if(grammarAppend(0) || grammarAppend(0)) { // The header of the rule
+        return 0;
+    }
+    *(rule_offsets + symval) = rule + 1;
+    if(symval < rule_offsets_low) {
+        rule_offsets_low = symval;
+    }
+    if(symval >= rule_offsets_high) {
+        rule_offsets_high = symval + 1;
+    }
+    grammar_rules++;
+
+    // Make rule body
+    while(1) {
+        class = readSymbol(in, &symval);
+        if(class & (UTF_TERMINAL | UTF_NONTERMINAL)) {
+            if(grammarAppend(symval)) {
+                return 0;
+            }
+        }
+        else if((class & UTF_END) && grammar_length - RULE_BODY(rule) >= 2) {
+            RULE_LENGTH(rule) = grammar_length - RULE_BODY(rule);
+            return symval;
+        }
+        else {
+            return 0;
+        }
     }
-    return 0;
 }
 
 
@@ -821,213 +985,3 @@ int isEOB(int b) {
 int isRD(int b) {
     return isMarkerValue(0x85, b);
 }
-
-
-/**
- * @brief Validates command line arguments passed to the program.
- * @details This function will validate all the arguments passed to the
- * program, returning 0 if validation succeeds and -1 if validation fails.
- * Upon successful return, the selected program options will be set in the
- * global variable "global_options", where they will be accessible
- * elsewhere in the program.
- *
- * @param argc The number of arguments passed to the program from the CLI.
- * @param argv The argument strings passed to the program from the CLI.
- * @return 0 if validation succeeds and -1 if validation fails.
- * Refer to the homework document for the effects of this function on
- * global variables.
- * @modifies global variable "global_options" to contain a bitmap representing
- * the selected options.
- */
-int validargs(int argc, char **argv) {
-    // Include helpers
-    int stringCompare(char *string1, char *string2);
-    int parseBlocksize(char *string);
-    void modifyGlobalOptions(int blocksize, char *flag);
-
-    // Variables
-    char *flagH = "-h";
-    char *flagC = "-c";
-    char *flagD = "-d";
-    char *flagB = "-b";
-    int defaultblocksize = 1024;
-
-    // Return PASS and modify global_options if -h is the first flag.
-    // There is at least 1 flag.
-    if (argc > 1 && stringCompare(flagH, *(argv + 1))) {
-        modifyGlobalOptions(defaultblocksize, flagH);
-        return 0;
-    }
-
-    // Return PASS and modify global options if -d is the only flag.
-    // Or if -c is the only flag.
-    // There is only 1 flag.
-    if(argc == 2) {
-        if(stringCompare(flagD, *(argv + 1))) {
-            modifyGlobalOptions(defaultblocksize, flagD);
-            return 0;
-        }
-        else if(stringCompare(flagC, *(argv + 1))) {
-            modifyGlobalOptions(defaultblocksize, flagC);
-            return 0;
-        }
-    }
-
-    // Return PASS and modify global options if -c is the first flag,
-    // -b is the second flag, and the third input is a number in [1, 1024].
-    // There are 3 additional arguments to the initial function.
-    if(argc == 4 && stringCompare(flagC, *(argv + 1)) && stringCompare(flagB, *(argv + 2))) {
-        int blocksize = parseBlocksize(*(argv + 3));
-        if(blocksize != -1) {
-            modifyGlobalOptions(blocksize, flagC);
-            return 0;
-        }
-    }
-
-    // Else return FAIL;
-    return -1;
-}
-
-/**
- * @brief Modifies global_options.
- * @details Modifies global_options based on the given blocksize and flag.
- *
- * @param blocksize The blocksize of global_options
- * @param flag The flag
- */
-void modifyGlobalOptions(int blocksize, char *flag) {
-    // Include helper functions
-    int stringCompare(char *string1, char *string2);
-
-    int temp = 0;
-    int flagbit = 0;
-    if(stringCompare("-h", flag)) {
-        flagbit = 0x1; // 0b0001
-        temp = flagbit;
-    }
-    else if(stringCompare("-c", flag)) {
-        flagbit = 0x2; // 0b0010
-        temp = blocksize;
-        temp = temp << 16;
-        temp = temp | flagbit;
-    }
-    else if(stringCompare("-d", flag)) {
-        flagbit = 0x4; // 0b0100
-        temp = flagbit;
-    }
-    global_options = temp;
-}
-
-/**
- * @brief Parses a given blocksize string and returns an integer.
- * @details This function will parse a given blocksize string and determine
- * if it is valid or not. If the string is valid, it returns the integer size,
- * otherwise, it returns -1.
- *
- * @param string Pointer to the string
- * @return The blocksize if successful, -1 if it is not a valid
- * blocksize.
- */
-int parseBlocksize(char *string) {
-    // Include helpers
-    int stringLength(char *string);
-
-    // Constants
-    int fail = -1;
-    int number = 0;
-    int loopCounter = 1;
-    char zero = '0';
-    char nine = '9';
-
-    // Get the last index of the string array.
-    int index = stringLength(string);
-    index--;
-
-    // Loop to construct integer value.
-    while(index >= 0) {
-        char c = *(string + index);
-        if(c < zero || c > nine) {
-            // Return FAIL if not a number character.
-            return fail;
-        }
-        else if(loopCounter > 1000) {
-            // Return FAIL if leading characters are not zeros
-            if(c != zero) {
-                return fail;
-            }
-        }
-        else if(loopCounter <= 1000) {
-            // Change into integer and add to number.
-            c = c - 48; // Ex. '0' = 48; 48 - 48 = 0; The 'real' number.
-            number = number + (c * loopCounter); // Ex. 0 = 0 + (0 * 1);
-            loopCounter = loopCounter * 10; // Ex. loopCounter = 10;
-        }
-        index--;
-    }
-
-    // Range of current number is [0-9999]
-    if(number < 1 || number > 1024) {
-        // Return FAIL if number is not in correct range.
-        return fail;
-    }
-    return number;
-}
-
-/**
- * @brief Returns the length of the given string.
- *
- * @param string Pointer to the string.
- * @return The length of the string.
- */
-int stringLength(char *string) {
-    int nullTerm = '\0';
-    int length = 0;
-
-    while(*string != nullTerm) {
-        length++;
-        string++;
-    }
-    return length;
-}
-
-/**
- * @brief Compares 2 strings and checks if they are equal.
- * @details This function will compare 2 strings passed in as arguments,
- * returning 1 if strings are equal and 0 if strings are not equal.
- *
- * @param string1 Pointer to the first string.
- * @param string2 Pointer to the second string.
- * @return 1 if the strings are equal and 0 if the strings are not equal.
- */
-int stringCompare(char *string1, char *string2) {
-    // Variables
-    char nullTerm = '\0';
-    int pass = 1;
-    int fail = 0;
-
-    while(1) {
-        if(*string1 == nullTerm && *string2 == nullTerm) {
-            // Return at the end of the string.
-            // Matched args.
-            return pass;
-        }
-        else if(*string1 == nullTerm || *string2 == nullTerm) {
-            // Return when one string is longer than the other.
-            // Unmatched args.
-            return fail;
-        }
-        else if(*string1 != *string2) {
-            // Return when characters at different.
-            // Unmatched args.
-            return fail;
-        }
-        else {
-            // Increment pointers by size of char
-            string1++;
-            string2++;
-        }
-    }
-
-    // Function never reaches here.
-    return pass;
-}
\ No newline at end of file
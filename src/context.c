@@ -0,0 +1,118 @@
+/*
+ * This module works on the fields of contexts other than the current one, so it
+ * does not want their names to stand for the fields of the current context.
+ */
+#define SEQ_CONTEXT_FIELDS
+
+#include "const.h"
+#include "sequitur.h"
+
+/*
+ * Contexts.
+ *
+ * A SEQ_CONTEXT holds all of the state of the compression engine.  The functions
+ * of the engine work on the current context of the calling thread, which is the
+ * default context until the thread chooses another one with use_context().
+ */
+
+/* Initial values of the fields of a context that do not start out as zero. */
+#define SEQ_CONTEXT_INIT { \
+    .next_nonterminal_value = FIRST_NONTERMINAL, \
+    .rule_generation = 1, \
+    .digram_generation = 1, \
+    .rule_offsets_low = SYMBOL_VALUE_MAX, \
+    .materialize_max = MATERIALIZE_MAX, \
+}
+
+/* The context used by threads that have not chosen one of their own. */
+static SEQ_CONTEXT default_context = SEQ_CONTEXT_INIT;
+
+_Thread_local SEQ_CONTEXT *seq_context = &default_context;
+
+/**
+ * Create a new context, in which no storage has yet been reserved.
+ * Storage for its symbols, rules and digrams is reserved the first time that
+ * compress() or decompress() runs in the context.
+ *
+ * @return  The new context, or NULL if there is not enough memory.
+ */
+SEQ_CONTEXT *new_context(void) {
+    SEQ_CONTEXT *ctx = malloc(sizeof(SEQ_CONTEXT));
+    if(ctx == NULL) {
+        return NULL;
+    }
+    *ctx = (SEQ_CONTEXT)SEQ_CONTEXT_INIT;
+    return ctx;
+}
+
+/**
+ * Free a context created by new_context(), together with all of the storage
+ * that has been reserved in it.  The context must not be current in any thread.
+ *
+ * @param ctx  The context to be freed.
+ */
+void free_context(SEQ_CONTEXT *ctx) {
+    if(ctx == NULL || ctx == &default_context) {
+        return;
+    }
+    int chunk = 0;
+    while(chunk < ctx->symbol_chunk_slots) {
+        free(*(ctx->symbol_chunks + chunk));
+        chunk++;
+    }
+    free(ctx->symbol_chunks);
+    free(ctx->digram_table);
+    free(ctx->rule_data);
+    free(ctx->free_rule_values);
+    free(ctx->grammar);
+    free(ctx->rule_offsets);
+    free(ctx->expand_stack);
+    free(ctx->expansions);
+    free(ctx->arena);
+    free(ctx);
+}
+
+/**
+ * Make a context the current context of the calling thread.
+ *
+ * @param ctx  The context to be made current, or NULL for the default context.
+ * @return  The context that was current before the call.
+ */
+SEQ_CONTEXT *use_context(SEQ_CONTEXT *ctx) {
+    SEQ_CONTEXT *prev = seq_context;
+    seq_context = ctx != NULL ? ctx : &default_context;
+    return prev;
+}
+
+/**
+ * Run compress() in a given context.  The current context of the calling thread
+ * is the same after the call as it was before.
+ *
+ * @param ctx  The context in which to compress.
+ * @param in  The stream from which input is to be read.
+ * @param out  The stream to which the transmission is to be written.
+ * @param bsize  The maximum number of bytes read per block.
+ * @return  The value returned by compress().
+ */
+int context_compress(SEQ_CONTEXT *ctx, FILE *in, FILE *out, int bsize) {
+    SEQ_CONTEXT *prev = use_context(ctx);
+    int ret = compress(in, out, bsize);
+    use_context(prev);
+    return ret;
+}
+
+/**
+ * Run decompress() in a given context.  The current context of the calling thread
+ * is the same after the call as it was before.
+ *
+ * @param ctx  The context in which to decompress.
+ * @param in  The stream from which the transmission is to be read.
+ * @param out  The stream to which the decompressed data is to be written.
+ * @return  The value returned by decompress().
+ */
+int context_decompress(SEQ_CONTEXT *ctx, FILE *in, FILE *out) {
+    SEQ_CONTEXT *prev = use_context(ctx);
+    int ret = decompress(in, out);
+    use_context(prev);
+    return ret;
+}
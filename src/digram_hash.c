@@ -5,24 +5,152 @@
  * Digram hash table.
  *
  * Maps pairs of symbol values to first symbol of digram.
- * Uses open addressing with linear probing.
+ * Uses open addressing with linear probing.  Each slot carries the packed key
+ * of its digram, so probes are decided from the table alone and symbol storage
+ * is only touched for the digram that is actually returned.
  * See, e.g. https://en.wikipedia.org/wiki/Open_addressing
  */
 
-// Function prototypes
-int isDigramMatchValues(SYMBOL *digram, int v1, int v2);
+/*
+ * The generation of a context starts at 1 (see context.c), so that the all-zero
+ * keys of a never-used table are not current.  The size of its digram_table, as a
+ * power of two, is digram_bits, which is set by reserve_digrams() and is zero until
+ * a table has been allocated.
+ */
 
+/* Smallest and largest tables that will be made. */
+#define DIGRAM_BITS_MIN 4
+#define DIGRAM_BITS_LIMIT 30
 
+/* Number of digrams in the table in the current generation, in the current context. */
+#define digram_count (seq_context->digram_count)
+
+/**
+ * Make sure that the digram table is large enough for the digrams of a given
+ * number of symbols.  The table is made at least twice that size, so that it
+ * stays at most half full.  If the current table is too small, it is replaced
+ * by a larger, empty one, so this must only be called before init_digram_hash()
+ * at the start of a block.  The table is never shrunk.
+ *
+ * @param count  The number of symbols whose digrams may be in the table at once.
+ * @return 0 if the table is large enough, -1 if it could not be allocated.
+ */
+int reserve_digrams(int count) {
+    int bits = DIGRAM_BITS_MIN;
+    while(bits < DIGRAM_BITS_LIMIT && (1 << bits) < 2 * (long)count) {
+        bits++;
+    }
+    if(digram_table != NULL && bits <= digram_bits) {
+        return 0;
+    }
+
+    // A fresh table is all zero keys, which are unused in every generation.
+    free(digram_table);
+    digram_table = calloc((size_t)1 << bits, sizeof(DIGRAM_SLOT));
+    if(digram_table == NULL) {
+        digram_bits = 0;
+        return -1;
+    }
+    digram_bits = bits;
+    return 0;
+}
+
+/*
+ * Probe statistics, compiled in only for "make stats" builds.
+ * Every table operation records how many slots it had to inspect, so that the
+ * effect of the hash function and probing scheme can be measured on real input.
+ * They are kept per thread, so that threads compressing at the same time do not share them.
+ */
+#ifdef DIGRAM_STATS
+static _Thread_local long digram_operations = 0;
+static _Thread_local long digram_probes = 0;
+static _Thread_local long digram_longest = 0;
+
+static void countProbes(long probes) {
+    digram_operations++;
+    digram_probes += probes;
+    if(probes > digram_longest) {
+        digram_longest = probes;
+    }
+}
+#define COUNT_PROBES(n) countProbes(n)
+#else
+#define COUNT_PROBES(n)
+#endif
+
+/**
+ * Report the probe statistics gathered since the last call to stderr,
+ * then reset them.  Does nothing unless compiled with DIGRAM_STATS.
+ */
+void digram_report(void) {
+#ifdef DIGRAM_STATS
+    fprintf(stderr, "digram table: %ld operations, %.3f slots/operation, "
+            "longest probe %ld, %ld entries (load %.3f)\n",
+            digram_operations,
+            digram_operations ? (double)digram_probes / digram_operations : 0.0,
+            digram_longest, (long)digram_count, (double)digram_count / MAX_DIGRAMS);
+    digram_operations = 0;
+    digram_probes = 0;
+    digram_longest = 0;
+#endif
+}
 
 /**
  * Clear the digram hash table.
+ *
+ * Entries are not erased; instead the table moves on to a new generation, in
+ * which all entries of earlier generations count as unused.  Only when the
+ * generation counter would overflow the bits available for it in a key is the
+ * table actually cleared and the counter started over.
  */
 void init_digram_hash(void) {
+    if(digram_generation < DIGRAM_GENERATION_MAX) {
+        digram_generation++;
+    }
+    else {
+        int count = 0;
+        while(count < MAX_DIGRAMS) {
+            (digram_table + count)->key = 0;
+            (digram_table + count)->first = NULL;
+            count++;
+        }
+        digram_generation = 1;
+    }
+    digram_count = 0;
+}
+
+/**
+ * Double the size of the digram table, moving the entries of the current
+ * generation into the new table.  If the new table cannot be allocated, the
+ * old one is kept; it still works, only with longer probe sequences.
+ */
+static void digram_grow(void) {
+    if(digram_bits >= DIGRAM_BITS_LIMIT) {
+        return;
+    }
+    DIGRAM_SLOT *old = digram_table;
+    int oldsize = MAX_DIGRAMS;
+    DIGRAM_SLOT *table = calloc((size_t)oldsize * 2, sizeof(DIGRAM_SLOT));
+    if(table == NULL) {
+        return;
+    }
+    digram_table = table;
+    digram_bits++;
+
+    // Keys are already stamped, so entries are moved as they are.
     int count = 0;
-    while(count < MAX_DIGRAMS) {
-        *(digram_table + count) = NULL;
+    while(count < oldsize) {
+        DIGRAM_SLOT *slot = old + count;
+        if(DIGRAM_SLOT_USED(slot)) {
+            int index = DIGRAM_KEY_HASH(slot->key);
+            while(DIGRAM_SLOT_USED(digram_table + index)) {
+                index = DIGRAM_NEXT(index);
+            }
+            *(digram_table + index) = *slot;
+        }
         count++;
     }
+    free(old);
 }
 
 /**
@@ -34,75 +162,28 @@ void init_digram_hash(void) {
  * symbol values) in the hash table, if there is one, otherwise NULL.
  */
 SYMBOL *digram_get(int v1, int v2) {
+    uint64_t key = DIGRAM_STAMP(DIGRAM_KEY(v1, v2));
     int index = DIGRAM_HASH(v1, v2);
-    int ret = 0;
-    SYMBOL *sym = NULL;
+    DIGRAM_SLOT *slot = NULL;
 
-    // Loop part 1
-    for(int i = index; i < MAX_DIGRAMS; i++) {
-        sym = *(digram_table + i);
-        if(sym == NULL) {
+    // Probe forward from the home slot, wrapping around at the end of the table.
+    for(int count = 1; count <= MAX_DIGRAMS; count++) {
+        slot = digram_table + index;
+        if(!DIGRAM_SLOT_USED(slot)) {
+            COUNT_PROBES(count);
             return NULL;
         }
-        else if(sym == TOMBSTONE) {
-            continue;
-        }
-
-        ret = isDigramMatchValues(sym, v1, v2);
-        if(ret) {
-            return sym;
-        }
-    }
-
-    // Loop part 2
-    for(int i = 0; i < index; i++) {
-        sym = *(digram_table + i);
-        if(sym == NULL) {
-            return NULL;
-        }
-        else if(sym == TOMBSTONE) {
-            continue;
-        }
-
-        ret = isDigramMatchValues(sym, v1, v2);
-        if(ret) {
-            return sym;
+        else if(slot->key == key) {
+            COUNT_PROBES(count);
+            return slot->first;
         }
+        index = DIGRAM_NEXT(index);
     }
 
+    COUNT_PROBES(MAX_DIGRAMS);
     return NULL;
 }
 
-/**
- * Deterimes if the digram symbol values match the given values
- * Helper function for digram_get
- *
- * @param SYMBOL *digram This digram to check the values of and see if it is similar to v1 and v2
- * @param int v1 The first symbol's value
- * @param int v2 The second symbol's value
- * @return 0 if nothing found, 1 if found match
- */
-int isDigramMatchValues(SYMBOL *digram, int v1, int v2) {
-    if (digram == NULL) {
-        return 0;  
-    }
-    
-    SYMBOL *sym1 = digram;
-    SYMBOL *sym2 = digram->next;
-    
-    if (sym1 == NULL || sym2 == NULL) { 
-        return 0;
-    }
-
-    int sym1val = sym1->value;  // Use arrow notation for clarity
-    int sym2val = sym2->value;
-    
-    if (sym1val == v1 && sym2val == v2) {
-        return 1;
-    }
-
-    return 0;
-}
 /**
  * Delete a specified digram from the hash table.
  *
@@ -110,10 +191,12 @@ int isDigramMatchValues(SYMBOL *digram, int v1, int v2) {
  * @return 0 if the digram was found and deleted, -1 if the digram did
  * not exist in the table.
  *
- * Note that deletion in an open-addressed hash table requires that a
- * special "tombstone" value be left as a replacement for the value being
- * deleted.  Tombstones are treated as vacant for the purposes of insertion,
- * but as filled for the purpose of lookups.
+ * Note that deletion in an open-addressed hash table must not break the
+ * probe sequence of any entry that lies beyond the deleted one.  Rather than
+ * leaving a tombstone, each following entry up to the next unused slot is
+ * checked, and an entry is moved back into the hole whenever its home slot
+ * does not lie cyclically between the hole and its current position.  The
+ * moved entry leaves a new hole behind, and the process continues from there.
  *
  * Note also that this function will only delete the specific digram that is
  * passed as the argument, not some other matching digram that happens
@@ -124,79 +207,59 @@ int isDigramMatchValues(SYMBOL *digram, int v1, int v2) {
  * sense to do it here.
  */
 int digram_delete(SYMBOL *digram) {
-    if (digram == NULL || digram->next == NULL) {
+    if (digram == NULL || digram->next == 0) {
         return -1;  
     }
 
-    SYMBOL *disym1 = NULL;
-    SYMBOL *disym2 = NULL;
-    SYMBOL *sym1 = digram;
-    SYMBOL *sym2 = digram->next;
-    int sym1val = sym1->value;
-    int sym2val = sym2->value;
+    DIGRAM_SLOT *slot = NULL;
+    int sym1val = digram->value;
+    int sym2val = NEXT(digram)->value;
+    uint64_t key = DIGRAM_STAMP(DIGRAM_KEY(sym1val, sym2val));
     int index = DIGRAM_HASH(sym1val, sym2val);
+    int found = 0;
 
     // Input debug
     debug("digram_delete: digramValue: %d, digramValue2: %d", sym1val, sym2val);
 
-    // TODO: Need to test for null within the loops
-
-    // Loop part 1
-    for(int i = index; i < MAX_DIGRAMS; i++) {
-
-        debug("index: %d", i);
+    for(int count = 1; count <= MAX_DIGRAMS; count++) {
+        debug("index: %d", index);
 
-        disym1 = *(digram_table + i);
-        if(disym1 == NULL) {
+        slot = digram_table + index;
+        if(!DIGRAM_SLOT_USED(slot)) {
+            COUNT_PROBES(count);
             return -1;
         }
-        else if(disym1 == TOMBSTONE) {
-            continue;
-        }
-
-        debug("disym1 is not null or tombstone");
 
-        disym2 = (*disym1).next;
-        if(disym2 == NULL) {
-            return -1;
-        }
-
-        debug("disym2 is not null");
-
-        if((disym1 == sym1) && (disym2 == sym2)) {
-            *(digram_table + i) = TOMBSTONE;
-            return 0;
+        // Only this exact digram is deleted, never another one with the same values.
+        if(slot->first == digram && slot->key == key) {
+            COUNT_PROBES(count);
+            found = 1;
+            break;
         }
+        index = DIGRAM_NEXT(index);
+    }
+    if(!found) {
+        COUNT_PROBES(MAX_DIGRAMS);
+        return -1;
     }
 
-    // Loop part 2
-    for(int i = 0; i < index; i++) {
-        debug("index: %d", i);
-
-        disym1 = *(digram_table + i);
-        if(disym1 == NULL) {
-            return -1;
-        }
-        else if(disym1 == TOMBSTONE) {
-            continue;
-        }
-
-        debug("disym1 is not null or tombstone");
-
-        disym2 = (*disym1).next;
-        if(disym2 == NULL) {
-            return -1;
-        }
-
-        debug("disym2 is not null");
-
-        if((disym1 == sym1) && (disym2 == sym2)) {
-            *(digram_table + i) = TOMBSTONE;
-            return 0;
+    // Backward shift: pull later entries of the cluster back into the hole.
+    int hole = index;
+    int next = DIGRAM_NEXT(hole);
+    while(next != hole && DIGRAM_SLOT_USED(digram_table + next)) {
+        int home = DIGRAM_KEY_HASH((digram_table + next)->key);
+        int fromhome = (next - home) & (MAX_DIGRAMS - 1);
+        int fromhole = (next - hole) & (MAX_DIGRAMS - 1);
+        if(fromhome >= fromhole) {
+            *(digram_table + hole) = *(digram_table + next);
+            hole = next;
         }
+        next = DIGRAM_NEXT(next);
     }
-
-    return -1;
+    (digram_table + hole)->key = 0;
+    (digram_table + hole)->first = NULL;
+    digram_count--;
+    return 0;
 }
 
 
@@ -211,66 +274,46 @@ int digram_delete(SYMBOL *digram) {
  * table being full or the given digram not being well-formed.
  */
 int digram_put(SYMBOL *digram) {
-    if (digram == NULL || digram->next == NULL) {
+    if (digram == NULL || digram->next == 0) {
         return -1;  
     }
 
-    SYMBOL *disym1 = NULL;
-    SYMBOL *disym2 = NULL;
-
-    SYMBOL *sym1 = digram;
-    if(sym1 == NULL) {
-        return -1;
-    }
+    debug("digram_put symbol is well formed");
 
-    SYMBOL *sym2 = digram->next;
-    if(sym2 == NULL) {
-        return -1;
+    // Keep the table at most half full, growing it if a block turns out to
+    // need more room than was reserved for it.
+    if(2 * (digram_count + 1) > MAX_DIGRAMS) {
+        digram_grow();
     }
 
-    debug("digram_put symbol is well formed");
-
-    int sym1val = (*sym1).value;
-    int sym2val = (*sym2).value;
+    DIGRAM_SLOT *slot = NULL;
+    int sym1val = digram->value;
+    int sym2val = NEXT(digram)->value;
+    uint64_t key = DIGRAM_STAMP(DIGRAM_KEY(sym1val, sym2val));
     int index = DIGRAM_HASH(sym1val, sym2val);
 
     debug("sym1val: %d, sym2val: %d, index: %d", sym1val, sym2val, index);
 
+    for(int count = 1; count <= MAX_DIGRAMS; count++) {
+        slot = digram_table + index;
 
-    // Loop part 1
-    for(int i = index; i < MAX_DIGRAMS; i++) {
-        disym1 = *(digram_table + i);
-
-        if((disym1 == NULL) || (disym1 == TOMBSTONE)) {
+        if(!DIGRAM_SLOT_USED(slot)) {
             // Did not exist, successful insert into digram
-            *(digram_table + i) = digram;
+            slot->key = key;
+            slot->first = digram;
+            COUNT_PROBES(count);
+            digram_count++;
             return 0;
         }
-
-        disym2 = (*disym1).next;
-        if(((*disym1).value == sym1val) && ((*disym2).value == sym2val)) {
-            // Same digram values, already exist
-            return 1;
-        }
-
-    }
-
-    // Loop part 2
-    for(int i = 0; i < index; i++) {
-        disym1 = *(digram_table + i);
-
-        if((disym1 == NULL) || (disym1 == TOMBSTONE)) {
-            // Did not exist, successful insert into digram
-            *(digram_table + i) = digram;
-            return 0;
-        }
-
-        disym2 = (*disym1).next;
-        if(((*disym1).value == sym1val) && ((*disym2).value == sym2val)) {
+        else if(slot->key == key) {
             // Same digram values, already exist
+            COUNT_PROBES(count);
             return 1;
         }
+        index = DIGRAM_NEXT(index);
     }
 
+    // Every slot is occupied.
+    COUNT_PROBES(MAX_DIGRAMS);
     return -1;
 }
@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "const.h"
+
+/*
+ * Input and output files named with -i and -o.
+ */
+
+/**
+ * Open the input named with -i, or standard input if there is none.
+ *
+ * @return  The stream to read input from, or NULL if the file cannot be opened.
+ */
+FILE *open_input(void) {
+    if(input_path == NULL) {
+        return stdin;
+    }
+    return fopen(input_path, "r");
+}
+
+/**
+ * Open the output named with -o, or standard output if there is none.  A
+ * regular output file has space set aside from an estimate of the size of the
+ * output, which is half the size of a regular input file when compressing and
+ * twice its size when decompressing, so that it is not fragmented as it grows.
+ *
+ * Opening the output truncates it, so a file that is also the input is refused
+ * before anything has been read from it.
+ *
+ * @param in  The stream input is read from.
+ * @param compressing  Nonzero when compressing, zero when decompressing.
+ * @return  The stream to write output to, or NULL if the file cannot be opened
+ * or is the input (errno is then EINVAL).
+ */
+FILE *open_output(FILE *in, int compressing) {
+    if(output_path == NULL) {
+        return stdout;
+    }
+    struct stat st;
+    struct stat ost;
+    int known = fstat(fileno(in), &st) == 0;
+    if(known && stat(output_path, &ost) == 0 && ost.st_dev == st.st_dev && ost.st_ino == st.st_ino) {
+        errno = EINVAL;
+        return NULL;
+    }
+    FILE *out = fopen(output_path, "w");
+    if(out != NULL && known && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t estimate = compressing ? st.st_size / 2 : st.st_size * 2;
+        // Only a hint: file systems without fallocate() just allocate as they go.
+        fallocate(fileno(out), FALLOC_FL_KEEP_SIZE, 0, estimate);
+    }
+    return out;
+}
+
+/**
+ * Finish with the output, closing it if it is a file named with -o.  Space set
+ * aside beyond the end of the output is given back.
+ *
+ * @param out  The stream output was written to.
+ * @return 0 if successful, otherwise EOF.
+ */
+int close_output(FILE *out) {
+    int ret = fflush(out);
+    if(out == stdout) {
+        return ret;
+    }
+    // The output may have been written straight to the file descriptor.
+    off_t length = lseek(fileno(out), 0, SEEK_CUR);
+    if(length >= 0 && ftruncate(fileno(out), length)) {
+        ret = EOF;
+    }
+    if(fclose(out) == EOF) {
+        ret = EOF;
+    }
+    return ret;
+}
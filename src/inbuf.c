@@ -0,0 +1,132 @@
+#include <string.h>
+#include <sys/mman.h>
+
+#include "const.h"
+#include "sequitur.h"
+
+/*
+ * Buffered input (see INBUF in sequitur.h).
+ */
+
+/**
+ * Set up an INBUF that reads from a stream.  If the stream is a regular file, the
+ * file is mapped into memory, and the INBUF reads the mapping from the current
+ * position of the stream on; otherwise the stream is read a buffer at a time.
+ *
+ * @param ib  The INBUF to be set up.
+ * @param stream  The stream to read from.
+ * @return 0 if successful, otherwise EOF.
+ */
+int inbuf_open(INBUF *ib, FILE *stream) {
+    ib->mapped = NULL;
+    ib->mapped_length = 0;
+    ib->uring = NULL;
+    if(inbuf_map(ib, stream) == 0) {
+        return 0;
+    }
+    ib->stream = stream;
+    ib->capacity = INBUF_SIZE;
+    ib->data = malloc(ib->capacity);
+    ib->next = ib->data;
+    ib->end = ib->data;
+    return ib->data == NULL ? EOF : 0;
+}
+
+/**
+ * Map the file behind a stream into memory for an INBUF, if it is a regular file
+ * with something left to be read.  The mapping is read only.
+ *
+ * @param ib  The INBUF.
+ * @param stream  The stream.
+ * @return 0 if the file has been mapped, otherwise -1.
+ */
+int inbuf_map(INBUF *ib, FILE *stream) {
+    struct stat st;
+    int fd = fileno(stream);
+    if(fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    off_t pos = ftello(stream);
+    if(pos < 0 || pos >= st.st_size) {
+        return -1;
+    }
+    unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    inbuf_memory(ib, map + pos, st.st_size - pos);
+    ib->data = map;
+    ib->mapped = stream;
+    ib->mapped_length = st.st_size;
+    return 0;
+}
+
+/**
+ * Set up an INBUF that reads bytes that are already in memory.  The bytes are
+ * not copied, and they must stay in place for as long as the INBUF is used.
+ *
+ * @param ib  The INBUF to be set up.
+ * @param data  The bytes to be read.
+ * @param length  The number of bytes to be read.
+ */
+void inbuf_memory(INBUF *ib, unsigned char *data, size_t length) {
+    ib->mapped = NULL;
+    ib->mapped_length = 0;
+    ib->uring = NULL;
+    ib->stream = NULL;
+    ib->capacity = 0;
+    ib->data = data;
+    ib->next = data;
+    ib->end = data + length;
+}
+
+/**
+ * Refill an INBUF, if it has fewer than INBUF_LOOKAHEAD bytes left to be read.
+ * The bytes that are left are moved to the start of the buffer, and the rest of
+ * the buffer is filled from the stream.
+ *
+ * @param ib  The INBUF.
+ * @return  The number of bytes left to be read, which is less than
+ * INBUF_LOOKAHEAD only when the input has run out.
+ */
+size_t inbuf_fill(INBUF *ib) {
+    size_t left = ib->end - ib->next;
+    if(left >= INBUF_LOOKAHEAD || ib->stream == NULL) {
+        return left;
+    }
+    if(ib->uring != NULL) {
+        return uring_fill(ib);
+    }
+    memmove(ib->data, ib->next, left);
+    size_t count = ib->capacity - left;
+    size_t n = fread(ib->data + left, 1, count, ib->stream);
+    if(n < count) {
+        // Only the end of the input, or an error, cuts a read short.
+        ib->stream = NULL;
+    }
+    ib->next = ib->data;
+    ib->end = ib->data + left + n;
+    return left + n;
+}
+
+/**
+ * Finish with an INBUF, freeing its buffer if it has one of its own.  A file that
+ * was mapped is unmapped, and its stream is left positioned just after the last
+ * byte that was read, as if the bytes had been read from the stream.
+ *
+ * @param ib  The INBUF.
+ */
+void inbuf_close(INBUF *ib) {
+    if(ib->mapped != NULL) {
+        fseeko(ib->mapped, ib->next - ib->data, SEEK_SET);
+        munmap(ib->data, ib->mapped_length);
+        ib->mapped = NULL;
+    }
+    else if(ib->capacity != 0) {
+        free(ib->data);
+    }
+    ib->data = NULL;
+    ib->next = NULL;
+    ib->end = NULL;
+}
@@ -18,10 +18,39 @@ int main(int argc, char **argv) {
     if(global_options & 1) {
         USAGE(*argv, EXIT_SUCCESS);
     }
-    else if(global_options & flagC) {
+
+    FILE *in = open_input();
+    if(in == NULL) {
+        perror(input_path);
+        return EXIT_FAILURE;
+    }
+    FILE *out = open_output(in, global_options & flagC);
+    if(out == NULL) {
+        perror(output_path);
+        return EXIT_FAILURE;
+    }
+
+    if(global_options & flagC) {
         int ret = 0;
-        ret = compress(stdin, stdout, (global_options>>16));
+        // The block size option is in Kbytes, compress() takes bytes.
+        int bsize = ((global_options >> 16) & 0xffff) << 10;
+        int jobs = (global_options >> 8) & 0xff;
+        if(jobs > 1) {
+            ret = compress_parallel(in, out, bsize, jobs);
+        }
+        else if(global_options & 0x8) { // -p
+            ret = compress_pipeline(in, out, bsize);
+        }
+        else if(global_options & 0x10) { // -u
+            ret = compress_uring(in, out, bsize);
+        }
+        else {
+            ret = compress(in, out, bsize);
+        }
 
+        if(close_output(out) == EOF) {
+            ret = EOF;
+        }
         if(ret == EOF) {
             USAGE(*argv, EXIT_FAILURE);
             return EXIT_FAILURE;
@@ -30,7 +59,20 @@ int main(int argc, char **argv) {
 
     }
     else if(global_options & flagD) {
-        int ret = decompress(stdin, stdout);
+        int ret = 0;
+        int jobs = (global_options >> 8) & 0xff;
+        if(jobs > 1) {
+            ret = decompress_parallel(in, out, jobs);
+        }
+        else if(global_options & 0x10) { // -u
+            ret = decompress_uring(in, out);
+        }
+        else {
+            ret = decompress(in, out);
+        }
+        if(close_output(out) == EOF) {
+            ret = EOF;
+        }
         if(ret == EOF) {
             USAGE(*argv, EXIT_FAILURE);
             return EXIT_FAILURE;
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "sequitur.h"
+
+/*
+ * Buffered output (see OUTBUF in sequitur.h).
+ */
+
+/**
+ * Set up an OUTBUF.
+ * Anything that the stream has buffered is flushed first, so that bytes that
+ * the OUTBUF writes directly to the file descriptor of the stream follow it.
+ *
+ * @param ob  The OUTBUF to be set up.
+ * @param stream  The stream to write to, or NULL to collect the output in memory.
+ * @return 0 if successful, otherwise EOF.
+ */
+int outbuf_open(OUTBUF *ob, FILE *stream) {
+    // Include helpers
+    int outbuf_map_pages(OUTBUF *ob);
+
+    ob->stream = stream;
+    ob->fd = -1;
+    ob->length = 0;
+    ob->total = 0;
+    ob->capacity = OUTBUF_SIZE;
+    ob->pages = NULL;
+    ob->uring = NULL;
+    if(stream != NULL) {
+        if(fflush(stream) == EOF) {
+            return EOF;
+        }
+        ob->fd = fileno(stream);
+#ifdef OUTBUF_VMSPLICE
+        if(outbuf_map_pages(ob) == 0) {
+            return 0;
+        }
+#endif
+    }
+    ob->data = malloc(ob->capacity);
+    return ob->data == NULL ? EOF : 0;
+}
+
+/**
+ * Set up the buffer of an OUTBUF that writes to a pipe, after making the pipe
+ * larger if possible.  The buffer is mapped by itself, so that its pages can be
+ * handed to the pipe and then dropped.  Only used when compiled with OUTBUF_VMSPLICE.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if the buffer has been set up, otherwise -1.
+ */
+int outbuf_map_pages(OUTBUF *ob) {
+    struct stat st;
+    if(ob->fd < 0 || fstat(ob->fd, &st) || !S_ISFIFO(st.st_mode)) {
+        return -1;
+    }
+    fcntl(ob->fd, F_SETPIPE_SZ, OUTBUF_PIPE_SIZE);
+    unsigned char *pages = mmap(NULL, ob->capacity, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED) {
+        return -1;
+    }
+    ob->pages = pages;
+    ob->data = pages;
+    return 0;
+}
+
+/**
+ * Hand a full buffer of an OUTBUF to its pipe with vmsplice(2), and then drop
+ * its pages, so that the buffer is filled again in fresh pages.  The pipe holds
+ * on to the pages it was handed, and so does a reader that splices them out of
+ * it, for as long as they need them; they must never be written again.
+ * Nothing is handed over if the pipe does not take it.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if the buffer has been handed over, 1 if nothing has been handed
+ * over and it is to be written instead, otherwise EOF.
+ */
+int outbuf_splice(OUTBUF *ob) {
+    struct iovec iov = {ob->data, ob->length};
+    while(iov.iov_len > 0) {
+        ssize_t n = vmsplice(ob->fd, &iov, 1, 0);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // A pipe that never took anything may just not support vmsplice().
+            return iov.iov_len == ob->length && errno != EPIPE ? 1 : EOF;
+        }
+        iov.iov_base = (unsigned char *)iov.iov_base + n;
+        iov.iov_len -= n;
+    }
+    if(madvise(ob->data, ob->capacity, MADV_DONTNEED)) {
+        return EOF;
+    }
+
+    // Fault the fresh pages in all at once; where this is not supported, they
+    // are faulted in one at a time as they are filled.
+    madvise(ob->data, ob->capacity, MADV_POPULATE_WRITE);
+    return 0;
+}
+
+/**
+ * Write out the contents of an OUTBUF, leaving it empty.  An OUTBUF that writes
+ * to a pipe hands a full buffer over instead (see outbuf_splice()).  An OUTBUF
+ * without a stream cannot be written out, so instead its buffer is made twice as large.
+ * Either way, there is room for at least OUTBUF_SIZE more bytes afterwards.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if successful, otherwise EOF.
+ */
+int outbuf_flush(OUTBUF *ob) {
+    if(ob->stream == NULL) {
+        unsigned char *data = realloc(ob->data, 2 * ob->capacity);
+        if(data == NULL) {
+            return EOF;
+        }
+        ob->data = data;
+        ob->capacity *= 2;
+        return 0;
+    }
+    if(ob->uring != NULL) {
+        return uring_flush(ob);
+    }
+
+    // Only buffers that take up all of their pages are handed to a pipe;
+    // the last one, which may not, is written instead.
+    int spliced = 1;
+    if(ob->pages != NULL && ob->length > ob->capacity - getpagesize()) {
+        spliced = outbuf_splice(ob);
+    }
+    if(spliced == EOF) {
+        return EOF;
+    }
+    else if(spliced == 0) {
+        // The buffer is in the pipe, and fresh pages have taken its place.
+    }
+    else if(ob->fd < 0) {
+        if(fwrite(ob->data, 1, ob->length, ob->stream) != ob->length) {
+            return EOF;
+        }
+    }
+    else {
+        unsigned char *p = ob->data;
+        unsigned char *end = ob->data + ob->length;
+        while(p < end) {
+            ssize_t n = write(ob->fd, p, end - p);
+            if(n < 0 && errno != EINTR) {
+                return EOF;
+            }
+            if(n > 0) {
+                p += n;
+            }
+        }
+    }
+    ob->total += ob->length;
+    ob->length = 0;
+    return 0;
+}
+
+/**
+ * Put a run of bytes in an OUTBUF, writing out the buffer as often as it fills up.
+ *
+ * @param ob  The OUTBUF.
+ * @param data  The bytes.
+ * @param length  The number of bytes.
+ * @return 0 if successful, otherwise EOF.
+ */
+int outbuf_write(OUTBUF *ob, unsigned char *data, size_t length) {
+    while(length > ob->capacity - ob->length) {
+        size_t n = ob->capacity - ob->length;
+        memcpy(ob->data + ob->length, data, n);
+        ob->length += n;
+        data += n;
+        length -= n;
+        if(outbuf_flush(ob)) {
+            return EOF;
+        }
+    }
+    memcpy(ob->data + ob->length, data, length);
+    ob->length += length;
+    return 0;
+}
+
+/**
+ * Finish with an OUTBUF.  An OUTBUF with a stream is written out, and its buffer
+ * is freed.  An OUTBUF without a stream keeps its buffer, which holds all of the
+ * output ("length" bytes) and is to be freed by the caller.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if successful, otherwise EOF.
+ */
+int outbuf_close(OUTBUF *ob) {
+    if(ob->stream == NULL) {
+        ob->total = ob->length;
+        return 0;
+    }
+    int ret = outbuf_flush(ob);
+    if(ob->uring != NULL) {
+        // The buffers belong to the io_uring.
+        if(uring_drain(ob->uring) == EOF) {
+            ret = EOF;
+        }
+    }
+    else if(ob->pages != NULL) {
+        munmap(ob->pages, ob->capacity);
+        ob->pages = NULL;
+    }
+    else {
+        free(ob->data);
+    }
+    ob->data = NULL;
+    return ret;
+}
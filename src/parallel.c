@@ -0,0 +1,473 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "const.h"
+#include "sequitur.h"
+#include "debug.h"
+
+/*
+ * Block-parallel compression and decompression.
+ *
+ * Blocks of a transmission are independent of each other: compression starts
+ * every block from scratch (compressInitBlockFunctions()), and decompression
+ * expands every block with only the rules of that block.  So both directions are
+ * done by cutting the input into "windows", each of which is turned into output
+ * by one of a number of worker threads, each of which works in a SEQ_CONTEXT of
+ * its own.  The calling thread reads the windows, hands them to the workers
+ * through a ring of window slots, and writes out the results in input order, so
+ * the output is byte-for-byte the same as that of compress() or decompress().
+ *
+ * For compression, a window is bsize bytes of input.  For decompression, a window
+ * is one block of the transmission, which is found by a structural pre-scan that
+ * follows the UTF-8 encoding of the symbols (see scanForEOB() in comdec.c).
+ *
+ * The ring has twice as many slots as there are workers, which bounds the
+ * memory used, while letting the workers get on with the next windows while
+ * the oldest one is being written out.
+ */
+
+/* The states of a window slot. */
+#define WINDOW_FREE 0          // Not in use
+#define WINDOW_POSTED 1        // Holds input, waiting for or being worked on
+#define WINDOW_DONE 2          // Holds the output
+#define WINDOW_FAILED 3        // The work failed
+
+/* Size of the buffer through which the decompression pre-scan reads its input. */
+#define STAGE_SIZE (64 << 10)
+
+typedef struct window {
+    unsigned char *data;       // Input bytes
+    size_t length;             // Number of input bytes
+    size_t capacity;           // Number of bytes of storage at data
+    unsigned char *blocks;     // Output bytes
+    size_t size;               // Number of output bytes
+    int state;
+} WINDOW;
+
+typedef struct pool POOL;
+
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t posted;     // Signalled when a window is posted or the input ends
+    pthread_cond_t done;       // Signalled when a window has been worked on
+    WINDOW *windows;           // Ring of window slots
+    int nwindows;
+    long next_post;            // Number of windows posted so far
+    long next_take;            // Number of windows taken by workers so far
+    int finished;              // Set when no more windows will be posted
+
+    /*
+     * Reads the input of the next window, in the calling thread.
+     * Returns the number of bytes read, 0 at the end of the input, or EOF.
+     */
+    long (*fill)(POOL *pool, WINDOW *w, FILE *in);
+
+    /* Turns the input of a window into its output, in a worker's context. 0 or EOF. */
+    int (*work)(POOL *pool, WINDOW *w);
+
+    int bsize;                 // Block size, for compression
+
+    unsigned char *stage;      // Input buffer of the decompression pre-scan
+    size_t stage_pos;
+    size_t stage_len;
+};
+
+typedef struct worker {
+    pthread_t thread;
+    POOL *pool;
+    SEQ_CONTEXT *ctx;
+} WORKER;
+
+/**
+ * The body of a worker thread: takes windows from the ring, in order, and
+ * works on them until there are no more.
+ *
+ * @param arg  The WORKER.
+ * @return NULL
+ */
+static void *poolWorker(void *arg) {
+    WORKER *worker = arg;
+    POOL *pool = worker->pool;
+    use_context(worker->ctx);
+
+    pthread_mutex_lock(&pool->lock);
+    while(1) {
+        while(pool->next_take == pool->next_post && !pool->finished) {
+            pthread_cond_wait(&pool->posted, &pool->lock);
+        }
+        if(pool->next_take == pool->next_post) {
+            break;
+        }
+        WINDOW *w = pool->windows + pool->next_take % pool->nwindows;
+        pool->next_take++;
+        pthread_mutex_unlock(&pool->lock);
+
+        int ret = pool->work(pool, w);
+
+        pthread_mutex_lock(&pool->lock);
+        w->state = ret == EOF ? WINDOW_FAILED : WINDOW_DONE;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    use_context(NULL);
+    return NULL;
+}
+
+/**
+ * Waits for the work on a window to finish, then writes out its output
+ * and frees the slot.
+ *
+ * @param out  The stream to write to, or NULL to just discard the output.
+ * @return The number of bytes written, or EOF if the work or writing failed.
+ */
+static long writeWindow(POOL *pool, WINDOW *w, FILE *out) {
+    pthread_mutex_lock(&pool->lock);
+    while(w->state == WINDOW_POSTED) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    int failed = w->state == WINDOW_FAILED;
+    pthread_mutex_unlock(&pool->lock);
+
+    long ret = w->size;
+    if(failed || out == NULL
+       || fwrite(w->blocks, 1, w->size, out) != w->size) {
+        ret = EOF;
+    }
+    free(w->blocks);
+    w->blocks = NULL;
+    w->size = 0;
+    w->state = WINDOW_FREE;
+    return ret;
+}
+
+/**
+ * Runs a pool of worker threads over the windows of an input, and writes out
+ * their output in input order.
+ *
+ * @param pool  The pool, of which "fill" and "work" have been set.
+ * @param in  The stream from which input is to be read.
+ * @param out  The stream to which output is to be written.
+ * @param jobs  The number of worker threads.
+ * @return The number of bytes written, in case of success, otherwise EOF.
+ */
+static long runPool(POOL *pool, FILE *in, FILE *out, int jobs) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->posted, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->nwindows = 2 * jobs;
+    pool->windows = calloc(pool->nwindows, sizeof(WINDOW));
+    WORKER *workers = calloc(jobs, sizeof(WORKER));
+    if(pool->windows == NULL || workers == NULL) {
+        free(pool->windows);
+        free(workers);
+        return EOF;
+    }
+
+    // Start the workers, each with a context of its own.
+    int started = 0;
+    int failed = 0;
+    while(started < jobs) {
+        WORKER *worker = workers + started;
+        worker->pool = pool;
+        worker->ctx = new_context();
+        if(worker->ctx == NULL) {
+            failed = 1;
+            break;
+        }
+        if(pthread_create(&worker->thread, NULL, poolWorker, worker)) {
+            free_context(worker->ctx);
+            failed = 1;
+            break;
+        }
+        started++;
+    }
+
+    // Read and post windows, writing out the oldest one whenever the ring is full.
+    // Windows read before a failure to read input are still written out, as they
+    // are by compress() and decompress().
+    long written = 0;
+    long next_write = 0;
+    int badinput = 0;
+    while(!failed) {
+        WINDOW *w = pool->windows + pool->next_post % pool->nwindows;
+        // A worker may be setting the state of the window, so read it under the lock.
+        pthread_mutex_lock(&pool->lock);
+        int busy = w->state != WINDOW_FREE;
+        pthread_mutex_unlock(&pool->lock);
+        if(busy) {
+            long ret = writeWindow(pool, w, out);
+            next_write++;
+            if(ret == EOF) {
+                failed = 1;
+                break;
+            }
+            written += ret;
+        }
+        long length = pool->fill(pool, w, in);
+        if(length == EOF) {
+            badinput = 1;
+        }
+        if(length <= 0) {
+            break;
+        }
+        debug("Posting window %ld (%zu bytes)", pool->next_post, w->length);
+        pthread_mutex_lock(&pool->lock);
+        w->state = WINDOW_POSTED;
+        pool->next_post++;
+        pthread_cond_signal(&pool->posted);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    // Write out the windows still in the ring, then let the workers go.
+    while(next_write < pool->next_post) {
+        WINDOW *w = pool->windows + next_write % pool->nwindows;
+        long ret = writeWindow(pool, w, failed ? NULL : out);
+        if(ret == EOF) {
+            failed = 1;
+        }
+        written += ret;
+        next_write++;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(WORKER *worker = workers; worker < workers + started; worker++) {
+        pthread_join(worker->thread, NULL);
+        free_context(worker->ctx);
+    }
+    for(WINDOW *w = pool->windows; w < pool->windows + pool->nwindows; w++) {
+        free(w->data);
+    }
+    free(pool->windows);
+    free(workers);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->posted);
+    pthread_cond_destroy(&pool->done);
+    return failed || badinput ? EOF : written;
+}
+
+/**
+ * Reads the next bsize bytes of input to be compressed into a window.
+ *
+ * @return The number of bytes read, 0 at the end of the input, or EOF.
+ */
+static long fillWindow(POOL *pool, WINDOW *w, FILE *in) {
+    if(w->data == NULL) {
+        if((w->data = malloc(pool->bsize)) == NULL) {
+            return EOF;
+        }
+        w->capacity = pool->bsize;
+    }
+    w->length = fread(w->data, 1, pool->bsize, in);
+    return w->length;
+}
+
+/**
+ * Compresses one window, in the current context, into memory.
+ *
+ * @param w  The window, whose input is compressed to blocks in its output.
+ * @return 0 if successful, otherwise EOF.
+ */
+static int compressWindowToMemory(POOL *pool, WINDOW *w) {
+    // Include helpers
+    int compressReserve(int bsize);
+    int compressToMemory(unsigned char *data, size_t length, unsigned char **blocks, size_t *size);
+
+    if(compressReserve(pool->bsize)) {
+        return EOF;
+    }
+    return compressToMemory(w->data, w->length, &w->blocks, &w->size);
+}
+
+/**
+ * Parallel compression function.
+ * Produces exactly the same transmission as compress(in, out, bsize), but
+ * compresses up to "jobs" blocks at the same time, each on a thread of its own.
+ *
+ * @param in  The stream from which input is to be read.
+ * @param out  The stream to which the transmission is to be written.
+ * @param bsize  The maximum number of bytes read per block.
+ * @param jobs  The number of compression threads.
+ * @return  The number of bytes written, in case of success,
+ * otherwise EOF.
+ */
+int compress_parallel(FILE *in, FILE *out, int bsize, int jobs) {
+    if(jobs <= 1) {
+        return compress(in, out, bsize);
+    }
+    if(bsize < 1 || BLOCK_SYMBOLS((long)bsize) > INT_MAX) {
+        return EOF;
+    }
+
+    if(fputc(0x81, out) == EOF) { // SOT
+        return EOF;
+    }
+    POOL pool = {.fill = fillWindow, .work = compressWindowToMemory, .bsize = bsize};
+    long written = runPool(&pool, in, out, jobs);
+    if(written == EOF || fputc(0x82, out) == EOF) { // EOT
+        return EOF;
+    }
+    fflush(out);
+    written += 2;
+    return written > INT_MAX ? EOF : written;
+}
+
+/**
+ * Makes sure that the stage of the pre-scan holds input, refilling it if
+ * everything in it has been scanned.
+ *
+ * @return The number of bytes in the stage yet to be scanned, 0 at the end of the input.
+ */
+static size_t stageFill(POOL *pool, FILE *in) {
+    if(pool->stage_pos == pool->stage_len) {
+        pool->stage_len = fread(pool->stage, 1, STAGE_SIZE, in);
+        pool->stage_pos = 0;
+    }
+    return pool->stage_len - pool->stage_pos;
+}
+
+/**
+ * Reads the next byte of input through the stage of the pre-scan.
+ *
+ * @return The byte, or EOF at the end of the input.
+ */
+static int stageGetc(POOL *pool, FILE *in) {
+    if(!stageFill(pool, in)) {
+        return EOF;
+    }
+    return *(pool->stage + pool->stage_pos++);
+}
+
+/**
+ * Appends bytes of input to a window, making room for them as needed.
+ *
+ * @return 0 if successful, otherwise EOF.
+ */
+static int appendWindow(WINDOW *w, unsigned char *bytes, size_t count) {
+    if(w->length + count > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : STAGE_SIZE;
+        while(capacity < w->length + count) {
+            capacity *= 2;
+        }
+        unsigned char *data = realloc(w->data, capacity);
+        if(data == NULL) {
+            return EOF;
+        }
+        w->data = data;
+        w->capacity = capacity;
+    }
+    memcpy(w->data + w->length, bytes, count);
+    w->length += count;
+    return 0;
+}
+
+/**
+ * The structural pre-scan of parallel decompression: finds the next block of the
+ * transmission and reads it, from just after its SOB up to and including its EOB,
+ * into a window.  The EOB is found by scanForEOB(), which follows the UTF-8
+ * encoding of the symbols so as not to take a continuation byte for EOB.
+ *
+ * @return The number of bytes in the block, 0 if the next marker is EOT, or EOF
+ * if the next byte starts neither a block nor the end of the transmission, or the
+ * input ends inside a block.
+ */
+static long scanBlock(POOL *pool, WINDOW *w, FILE *in) {
+    // Include helpers
+    unsigned char *scanForEOB(unsigned char *p, unsigned char *end, int *pending);
+
+    int byte = stageGetc(pool, in);
+    if(byte == 0x82) { // EOT
+        return 0;
+    }
+    if(byte != 0x83) { // SOB
+        return EOF;
+    }
+
+    w->length = 0;
+    int pending = 0; // Continuation bytes still to come in the current symbol
+    while(stageFill(pool, in)) {
+        unsigned char *start = pool->stage + pool->stage_pos;
+        unsigned char *end = pool->stage + pool->stage_len;
+        unsigned char *p = scanForEOB(start, end, &pending);
+        int found = p != NULL;
+        if(!found) {
+            p = end;
+        }
+        if(appendWindow(w, start, p - start)) {
+            return EOF;
+        }
+        pool->stage_pos = p - pool->stage;
+        if(found) {
+            return w->length;
+        }
+    }
+    return EOF;
+}
+
+/**
+ * Decompresses one block, in the current context, into memory.
+ *
+ * @param w  The window, whose input is a block from just after SOB up to and
+ * including EOB, and whose output is the expansion of the block.
+ * @return 0 if successful, otherwise EOF.
+ */
+static int decompressWindowToMemory(POOL *pool, WINDOW *w) {
+    // Include helpers
+    int init_grammar(void);
+    int readBlockData(INBUF *in);
+    int mapBodyRules(OUTBUF *out);
+
+    if(init_grammar()) {
+        return EOF;
+    }
+    INBUF in;
+    inbuf_memory(&in, w->data, w->length);
+    OUTBUF out;
+    if(outbuf_open(&out, NULL) == EOF) {
+        return EOF;
+    }
+    int ret = 0;
+    if(!readBlockData(&in) || !mapBodyRules(&out) || inbuf_getc(&in) != EOF) {
+        ret = EOF;
+    }
+    outbuf_close(&out);
+    w->blocks = out.data;
+    w->size = out.length;
+    return ret;
+}
+
+/**
+ * Parallel decompression function.
+ * Produces exactly the same output as decompress(in, out), but expands up to
+ * "jobs" blocks at the same time, each on a thread of its own.
+ *
+ * @param in  The stream from which the transmission is to be read.
+ * @param out  The stream to which the decompressed data is to be written.
+ * @param jobs  The number of decompression threads.
+ * @return  The number of bytes written, in case of success,
+ * otherwise EOF.
+ */
+int decompress_parallel(FILE *in, FILE *out, int jobs) {
+    if(jobs <= 1) {
+        return decompress(in, out);
+    }
+    if(fgetc(in) != 0x81) { // SOT
+        return EOF;
+    }
+
+    POOL pool = {.fill = scanBlock, .work = decompressWindowToMemory};
+    if((pool.stage = malloc(STAGE_SIZE)) == NULL) {
+        return EOF;
+    }
+    long written = runPool(&pool, in, out, jobs);
+    // The scan stopped at EOT, which must be the last byte of the transmission.
+    if(written != EOF && stageGetc(&pool, in) != EOF) {
+        written = EOF;
+    }
+    free(pool.stage);
+    fflush(out);
+    return written > INT_MAX ? EOF : written;
+}
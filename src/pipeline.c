@@ -0,0 +1,349 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "const.h"
+#include "sequitur.h"
+#include "debug.h"
+
+/*
+ * Pipelined compression.
+ *
+ * compress() reads a byte, adds it to the grammar, and at the end of a block
+ * writes the block out, all on one thread, so the grammar is not being built
+ * while the thread waits for input or output.  Pipelined compression splits the
+ * work into three stages that run at the same time on threads of their own:
+ *
+ *    reader  -->  compressor  -->  writer
+ *
+ * The reader fills buffers with bsize bytes of input each, the compressor (the
+ * calling thread) compresses each buffer into memory in the current context,
+ * and the writer writes the compressed blocks out.  The stages pass buffers to
+ * each other through bounded queues, and the writer hands them back to the
+ * reader, so PIPELINE_DEPTH buffers are all that is ever used.
+ *
+ * Each queue has exactly one producer and one consumer, so it is a lock-free
+ * ring, with the position of each end kept in an atomic counter.  Only a stage
+ * that finds its queue empty (or full) takes the queue's lock, to sleep until the
+ * other end wakes it up, so a stage with nothing to do does not burn a processor.
+ * The time each stage spends waiting is measured, to report how busy it was.
+ */
+
+/* Number of buffers in the pipeline; also the capacity of each queue (a power of two). */
+#define PIPELINE_DEPTH 4
+
+typedef struct buffer {
+    unsigned char *data;       // Input bytes (bsize bytes of storage)
+    size_t length;             // Number of input bytes
+    unsigned char *blocks;     // Compressed blocks, from the first SOB to the last EOB
+    size_t size;               // Number of bytes of compressed blocks
+} BUFFER;
+
+typedef struct queue {
+    atomic_ulong head;         // Number of buffers taken from the queue
+    atomic_ulong tail;         // Number of buffers put in the queue
+    BUFFER **slots;            // PIPELINE_DEPTH slots
+    atomic_int waiters;        // Number of threads asleep on the queue
+    pthread_mutex_t lock;      // Held only by threads that go to sleep or wake them up
+    pthread_cond_t wake;
+} QUEUE;
+
+typedef struct stage {
+    struct timespec start;     // When the stage started
+    double busy;               // Seconds spent not waiting on a queue
+    double wall;               // Seconds from start to finish
+} STAGE;
+
+typedef struct pipeline {
+    FILE *in;
+    FILE *out;
+    int bsize;
+    QUEUE free;                // Writer to reader: empty buffers
+    QUEUE full;                // Reader to compressor: buffers of input
+    QUEUE done;                // Compressor to writer: compressed buffers
+    atomic_int failed;         // Set by any stage that fails
+    long written;              // Number of bytes written by the writer
+    STAGE reader;
+    STAGE compressor;
+    STAGE writer;
+} PIPELINE;
+
+/**
+ * Returns the number of seconds since a given time.
+ */
+static double secondsSince(struct timespec *t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec) / 1e9;
+}
+
+/**
+ * Puts a thread to sleep on a queue until one of the counters of the queue moves
+ * away from a given value.  The waiter count is raised before the counter is
+ * checked again, and the other end of the queue checks the waiter count after
+ * moving its counter, so (all of these being sequentially consistent) either
+ * this thread sees the move or the other end sees the waiter and wakes it up.
+ *
+ * @param counter  The head or the tail of the queue.
+ * @param value  The value that the counter has to move away from.
+ * @param stage  The stage of the calling thread, which is charged for the wait.
+ */
+static void queueWait(QUEUE *q, atomic_ulong *counter, unsigned long value, STAGE *stage) {
+    struct timespec wait;
+    clock_gettime(CLOCK_MONOTONIC, &wait);
+    pthread_mutex_lock(&q->lock);
+    atomic_fetch_add(&q->waiters, 1);
+    while(atomic_load(counter) == value) {
+        pthread_cond_wait(&q->wake, &q->lock);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    pthread_mutex_unlock(&q->lock);
+    stage->busy -= secondsSince(&wait);
+}
+
+/**
+ * Wakes up any thread asleep on a queue, after one of its counters has moved.
+ */
+static void queueWake(QUEUE *q) {
+    if(atomic_load(&q->waiters)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_broadcast(&q->wake);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+/**
+ * Puts a buffer at the tail of a queue, waiting while the queue is full.
+ * Only one thread may put buffers in a given queue.
+ *
+ * @param buf  The buffer, or NULL to mark the end of the stream of buffers.
+ * @param stage  The stage of the calling thread, which is charged for the wait.
+ */
+static void queuePut(QUEUE *q, BUFFER *buf, STAGE *stage) {
+    unsigned long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned long head = atomic_load(&q->head);
+    if(tail - head == PIPELINE_DEPTH) {
+        queueWait(q, &q->head, head, stage);
+    }
+    *(q->slots + tail % PIPELINE_DEPTH) = buf;
+    atomic_store(&q->tail, tail + 1);
+    queueWake(q);
+}
+
+/**
+ * Takes a buffer from the head of a queue, waiting while the queue is empty.
+ * Only one thread may take buffers from a given queue.
+ *
+ * @param stage  The stage of the calling thread, which is charged for the wait.
+ * @return The buffer, or NULL at the end of the stream of buffers.
+ */
+static BUFFER *queueTake(QUEUE *q, STAGE *stage) {
+    unsigned long head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if(atomic_load(&q->tail) == head) {
+        queueWait(q, &q->tail, head, stage);
+    }
+    BUFFER *buf = *(q->slots + head % PIPELINE_DEPTH);
+    atomic_store(&q->head, head + 1);
+    queueWake(q);
+    return buf;
+}
+
+/**
+ * Sets up an empty queue with the given slots.
+ */
+static void queueInit(QUEUE *q, BUFFER **slots) {
+    q->slots = slots;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wake, NULL);
+}
+
+/**
+ * Releases the lock and condition of a queue.
+ */
+static void queueFini(QUEUE *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->wake);
+}
+
+/**
+ * Starts the clock of a stage.
+ */
+static void stageStart(STAGE *stage) {
+    clock_gettime(CLOCK_MONOTONIC, &stage->start);
+    stage->busy = 0;
+}
+
+/**
+ * Stops the clock of a stage.  Time not spent waiting on a queue counts as busy.
+ */
+static void stageStop(STAGE *stage) {
+    stage->wall = secondsSince(&stage->start);
+    stage->busy += stage->wall;
+}
+
+/**
+ * The reader stage: fills empty buffers with input and passes them on to the
+ * compressor, until the input ends or a stage fails.
+ *
+ * @param arg  The PIPELINE.
+ * @return NULL
+ */
+static void *pipelineReader(void *arg) {
+    PIPELINE *p = arg;
+    stageStart(&p->reader);
+    while(1) {
+        BUFFER *buf = queueTake(&p->free, &p->reader);
+        if(atomic_load(&p->failed)) {
+            break;
+        }
+        buf->length = fread(buf->data, 1, p->bsize, p->in);
+        if(buf->length == 0) {
+            break;
+        }
+        queuePut(&p->full, buf, &p->reader);
+    }
+    queuePut(&p->full, NULL, &p->reader);
+    stageStop(&p->reader);
+    return NULL;
+}
+
+/**
+ * The writer stage: writes out compressed buffers and hands them back to the
+ * reader, until the compressor marks the end of the stream.  After a failure,
+ * buffers are handed back without being written out.
+ *
+ * @param arg  The PIPELINE.
+ * @return NULL
+ */
+static void *pipelineWriter(void *arg) {
+    PIPELINE *p = arg;
+    stageStart(&p->writer);
+    BUFFER *buf;
+    while((buf = queueTake(&p->done, &p->writer)) != NULL) {
+        if(!atomic_load(&p->failed)) {
+            if(fwrite(buf->blocks, 1, buf->size, p->out) != buf->size) {
+                atomic_store(&p->failed, 1);
+            }
+            p->written += buf->size;
+        }
+        free(buf->blocks);
+        buf->blocks = NULL;
+        queuePut(&p->free, buf, &p->writer);
+    }
+    stageStop(&p->writer);
+    return NULL;
+}
+
+/**
+ * Prints how busy a stage of a pipeline was, in "make stats" builds.
+ */
+static void stageReport(char *name, STAGE *stage) {
+#ifdef PIPELINE_STATS
+    fprintf(stderr, "pipeline %-10s: busy %.3fs of %.3fs (%.1f%%)\n", name, stage->busy,
+            stage->wall, stage->wall > 0 ? 100 * stage->busy / stage->wall : 0.0);
+#endif
+}
+
+/**
+ * Pipelined compression function.
+ * Produces exactly the same transmission as compress(in, out, bsize), but
+ * reads the input and writes the output on threads of their own, so that
+ * input and output overlap with compression.
+ *
+ * @param in  The stream from which input is to be read.
+ * @param out  The stream to which the transmission is to be written.
+ * @param bsize  The maximum number of bytes read per block.
+ * @return  The number of bytes written, in case of success,
+ * otherwise EOF.
+ */
+int compress_pipeline(FILE *in, FILE *out, int bsize) {
+    // Include helpers
+    int compressReserve(int bsize);
+    int compressToMemory(unsigned char *data, size_t length, unsigned char **blocks, size_t *size);
+
+    if(compressReserve(bsize)) {
+        return EOF;
+    }
+    PIPELINE *p = calloc(1, sizeof(PIPELINE));
+    BUFFER *buffers = calloc(PIPELINE_DEPTH, sizeof(BUFFER));
+    BUFFER **slots = calloc(3 * PIPELINE_DEPTH, sizeof(BUFFER *));
+    int ret = 0;
+    if(p == NULL || buffers == NULL || slots == NULL) {
+        ret = EOF;
+    }
+    for(BUFFER *buf = buffers; ret != EOF && buf < buffers + PIPELINE_DEPTH; buf++) {
+        if((buf->data = malloc(bsize)) == NULL) {
+            ret = EOF;
+        }
+    }
+    if(ret == EOF || fputc(0x81, out) == EOF) { // SOT
+        for(BUFFER *buf = buffers; buffers != NULL && buf < buffers + PIPELINE_DEPTH; buf++) {
+            free(buf->data);
+        }
+        free(buffers);
+        free(slots);
+        free(p);
+        return EOF;
+    }
+    p->in = in;
+    p->out = out;
+    p->bsize = bsize;
+    queueInit(&p->free, slots);
+    queueInit(&p->full, slots + PIPELINE_DEPTH);
+    queueInit(&p->done, slots + 2 * PIPELINE_DEPTH);
+    for(BUFFER *buf = buffers; buf < buffers + PIPELINE_DEPTH; buf++) {
+        queuePut(&p->free, buf, &p->compressor);
+    }
+
+    stageStart(&p->compressor);
+    pthread_t reader, writer;
+    int started = 0;
+    if(pthread_create(&reader, NULL, pipelineReader, p) == 0) {
+        started++;
+        if(pthread_create(&writer, NULL, pipelineWriter, p) == 0) {
+            started++;
+        }
+    }
+    if(started == 2) {
+        BUFFER *buf;
+        while((buf = queueTake(&p->full, &p->compressor)) != NULL) {
+            if(!atomic_load(&p->failed)
+               && compressToMemory(buf->data, buf->length, &buf->blocks, &buf->size) == EOF) {
+                atomic_store(&p->failed, 1);
+            }
+            queuePut(&p->done, buf, &p->compressor);
+        }
+        queuePut(&p->done, NULL, &p->compressor);
+        pthread_join(writer, NULL);
+    }
+    else {
+        // Without a writer to hand buffers back, stop the reader at its next one.
+        atomic_store(&p->failed, 1);
+        while(started && queueTake(&p->full, &p->compressor) != NULL) {
+            continue;
+        }
+    }
+    if(started) {
+        pthread_join(reader, NULL);
+    }
+    stageStop(&p->compressor);
+    stageReport("reader", &p->reader);
+    stageReport("compressor", &p->compressor);
+    stageReport("writer", &p->writer);
+
+    long written = p->written + 2; // With SOT and EOT
+    if(started < 2 || atomic_load(&p->failed) || fputc(0x82, out) == EOF) { // EOT
+        written = EOF;
+    }
+    fflush(out);
+    for(BUFFER *buf = buffers; buf < buffers + PIPELINE_DEPTH; buf++) {
+        free(buf->data);
+    }
+    free(buffers);
+    queueFini(&p->free);
+    queueFini(&p->full);
+    queueFini(&p->done);
+    free(slots);
+    free(p);
+    return written > INT_MAX ? EOF : written;
+}
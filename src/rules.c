@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "const.h"
 #include "sequitur.h"
 
@@ -15,12 +17,9 @@
  * performed, in which an instance of the head of the rule is expanded
  * by replacing it by an instance of the body of the rule.
  *
- * Here we don't introduce a separate structure for rules, but instead use
- * the existing SYMBOL structure to represent them.  A rule is represented
- * by a circular, doubly linked list of SYMBOL structures (representing the
- * body of the list), with an additional SYMBOL structure (representing the
- * head of the list) used as a "sentinel" that connects between the first
- * symbol in the body of the list and the last.
+ * The body of a rule is a circular, doubly linked list of SYMBOL structures,
+ * with an additional SYMBOL structure (representing the head of the rule) used as
+ * a "sentinel" that connects between the first symbol in the body and the last.
  *
  *    H <-> B1 <-> B2 <-> ... <-> Bn
  *    ^                           ^
@@ -28,42 +27,131 @@
  *    +---------------------------+
  *
  * The "next" and "prev" fields of the SYMBOL structure are used to create the
- * doubly linked list.  The sentinel node H is identifiable by the fact that it
- * has a non-NULL "rule" field that points back to itself.  Nonterminal nodes
- * in the body of the list may also have non-NULL pointers in their rule field,
- * but these will point to the heads of other rules, not back to the symbols
- * themselves.
+ * doubly linked list.  Everything else about a rule is kept in the RULE_DATA
+ * table, rule_data, which is indexed by the value of the head: the entry for a
+ * value records which symbol is the head of the rule with that value, if there
+ * is one, together with the reference count of the rule.  The sentinel node H is
+ * identifiable by the fact that it is the head recorded in the entry for its
+ * value.  Nonterminal nodes in the body of the list have values with entries too,
+ * but those entries record the heads of other rules, not the nodes themselves.
  *
  * Rules are also maintained in a list of all rules, which is also a circular,
- * doubly linked list, but it uses the "nextr" and "prevr" fields in the SYMBOL
- * structure rather than the "next" and "prev" fields that are used within a rule.
- * The list is accessed via the "main_rule" variable, which points to the
+ * doubly linked list, but it uses the "nextr" and "prevr" fields in the RULE_DATA
+ * entry of the head rather than the "next" and "prev" fields that are used within
+ * a rule.  The list is accessed via the "main_rule" variable, which points to the
  * head of a rule.  The heads of other rules in the list are accessed by following
- * the nextr and prevr pointers starting from the head of the main rule.
+ * the nextr and prevr links starting from the head of the main rule.
  * The main rule is not used as a special sentinel; it is simply an ordinary rule
  * like the others in the list.  When traversing the list forward and backward,
  * one can use the main_rule variable to identify when the beginning or end of
  * the list has been reached.
  */
 
+/*
+ * Stack of the values of rules deleted during the current block.  Fresh values
+ * are handed out first, so these are only used by blocks that are large enough
+ * to run through every value up to LAST_NONTERMINAL.
+ */
+#define free_rule_values (seq_context->free_rule_values)
+#define free_rule_count (seq_context->free_rule_count)
+#define free_rule_slots (seq_context->free_rule_slots)
+
 /**
- * Initializes the rules by setting main_rule to NULL and clearing the rule_map.
+ * Initializes the rules by setting main_rule to NULL and removing the heads
+ * from the table of rule data.
+ *
+ * Heads are not erased; instead the table moves on to a new generation, in which
+ * the heads entered in earlier generations do not count.  Only when the generation
+ * counter would overflow is the table actually cleared and the counter started over.
  */
 void init_rules(void) {
     // Set main_rule to null
     main_rule = NULL;
 
-    // Clear the rule_map or recursively set it to null using main_rule
-    int count = 0;
-    while(count < SYMBOL_VALUE_MAX) {
-        *(rule_map + count) = NULL;
-        count++;
+    if(rule_generation < RULE_GENERATION_MAX) {
+        rule_generation++;
+    }
+    else {
+        if(rule_data != NULL) {
+            memset(rule_data, 0, (SYMBOL_VALUE_MAX + 1) * sizeof(RULE_DATA));
+        }
+        rule_generation = 1;
     }
 
-    // main_rule = new_rule(FIRST_NONTERMINAL); 
-    // main_rule->prevr = main_rule;
-    // main_rule->nextr = main_rule;
+    // Values freed in an earlier block are fresh again
+    free_rule_count = 0;
+}
 
+/**
+ * Choose the value for the head of a new rule.
+ * Values are taken in order from next_nonterminal_value until they reach
+ * LAST_NONTERMINAL, after which values of deleted rules are reused.  If no value
+ * is left at all, a message is printed to stderr and abort() is called;
+ * rule_values_left() can be used to stop before that happens.
+ *
+ * @return  A nonterminal value that no rule currently uses.
+ */
+int new_rule_value(void) {
+    if(next_nonterminal_value <= LAST_NONTERMINAL) {
+        return next_nonterminal_value++;
+    }
+    if(free_rule_count > 0) {
+        free_rule_count--;
+        return *(free_rule_values + free_rule_count);
+    }
+    fprintf(stderr, "%s\n", "Error. Nonterminal values exhausted.");
+    abort();
+}
+
+/**
+ * Count the values new_rule_value() can still hand out in the current block.
+ *
+ * @return  The number of unused nonterminal values.
+ */
+int rule_values_left(void) {
+    return LAST_NONTERMINAL + 1 - next_nonterminal_value + free_rule_count;
+}
+
+/**
+ * Make the value of a deleted rule available to new_rule_value() again.
+ *
+ * @param value  The value of the deleted rule.
+ */
+static void free_rule_value(int value) {
+    if(free_rule_count == free_rule_slots) {
+        int slots = free_rule_slots ? 2 * free_rule_slots : 1024;
+        int *values = realloc(free_rule_values, slots * sizeof(int));
+        if(values == NULL) {
+            return; // The value is simply not reused
+        }
+        free_rule_values = values;
+        free_rule_slots = slots;
+    }
+    *(free_rule_values + free_rule_count) = value;
+    free_rule_count++;
+}
+
+/**
+ * Enter a rule into the table of rule data, so that it can be found from its
+ * head value.  This is what makes the head a sentinel and what nonterminal
+ * symbols with the same value refer to.
+ *
+ * @param rule  The rule to be entered.  The value of its head must be less
+ * than SYMBOL_VALUE_MAX.
+ */
+void map_rule(SYMBOL *rule) {
+    // The table is allocated on first use, with an extra entry for RECYCLED_VALUE.
+    // Pages of it that no rule value falls into are never touched.
+    if(rule_data == NULL) {
+        rule_data = calloc(SYMBOL_VALUE_MAX + 1, sizeof(RULE_DATA));
+        if(rule_data == NULL) {
+            fprintf(stderr, "cannot allocate rule data\n");
+            abort();
+        }
+    }
+
+    RULE_DATA_OF(rule)->head = SYMBOL_REF(rule);
+    RULE_DATA_OF(rule)->generation = rule_generation;
 }
 
 /**
@@ -73,19 +161,25 @@ void init_rules(void) {
  * a nonterminal symbol, the specified value must be in the range of values appropriate
  * for such symbols.
  * @return  A pointer to the head of the newly created rule.  The "value" field of the
- * returned structure is initialized to the specified value.  The "rule" field is
- * initialized to point back to the structure itself.  In addition, then "next" and "prev"
- * fields are also initialized to point back to the structure itself; representing an
- * empty rule body.
+ * returned structure is initialized to the specified value, and the rule is entered
+ * into the table of rule data with a reference count of zero.  In addition, the "next"
+ * and "prev" fields are initialized to point back to the structure itself; representing
+ * an empty rule body.
  *
  * Note that the actual insertion and deletion of symbols in the body of a list is
  * the responsiblity of the client of this module.
  */
 SYMBOL *new_rule(int v) {
     SYMBOL *rule = new_symbol(v, NULL);
-    (*rule).rule = rule;
-    (*rule).next = rule;
-    (*rule).prev = rule;
+    SET_NEXT(rule, rule);
+    SET_PREV(rule, rule);
+
+    // A value may have been used by a rule of an earlier block or a deleted rule.
+    map_rule(rule);
+    RULE_DATA *data = RULE_DATA_OF(rule);
+    (*data).refcnt = 0;
+    (*data).nextr = 0;
+    (*data).prevr = 0;
 
     return rule;
 }
@@ -114,14 +208,14 @@ void add_rule(SYMBOL *rule) {
     // }
     if (main_rule == NULL) {
         main_rule = rule;
-        rule->prevr = rule;  
-        rule->nextr = rule;  
+        SET_PREVR(rule, rule);
+        SET_NEXTR(rule, rule);
     } else {
         // Add to existing rules chain
-        rule->nextr = main_rule;
-        rule->prevr = main_rule->prevr;
-        main_rule->prevr->nextr = rule;
-        main_rule->prevr = rule;
+        SET_NEXTR(rule, main_rule);
+        SET_PREVR(rule, PREVR(main_rule));
+        SET_NEXTR(PREVR(main_rule), rule);
+        SET_PREVR(main_rule, rule);
     }
 }
 
@@ -138,13 +232,15 @@ void add_rule(SYMBOL *rule) {
  */
 void delete_rule(SYMBOL *rule) {
     // Remove from doubly linked list
-    (*((*rule).prevr)).nextr = (*rule).nextr;
-    (*((*rule).nextr)).prevr = (*rule).prevr;
-    (*rule).nextr = NULL;
-    (*rule).prevr = NULL;
+    RULE_DATA_OF(PREVR(rule))->nextr = RULE_DATA_OF(rule)->nextr;
+    RULE_DATA_OF(NEXTR(rule))->prevr = RULE_DATA_OF(rule)->prevr;
+    RULE_DATA_OF(rule)->nextr = 0;
+    RULE_DATA_OF(rule)->prevr = 0;
 
     // If refcnt is zero, recycle it. But why? What happens to the ones not recycled?
-    if((*rule).refcnt == 0) {
+    if(REFCNT(rule) == 0) {
+        free_rule_value((*rule).value);
+        RULE_DATA_OF(rule)->head = 0;
         recycle_symbol(rule);
     }
 }
@@ -156,7 +252,7 @@ void delete_rule(SYMBOL *rule) {
  * @return  The same rule that was passed as argument.
  */
 SYMBOL *ref_rule(SYMBOL *rule) {
-    (*rule).refcnt = (*rule).refcnt + 1;
+    REFCNT(rule) = REFCNT(rule) + 1;
     return rule;
 }
 
@@ -169,46 +265,11 @@ SYMBOL *ref_rule(SYMBOL *rule) {
  *
  */
 void unref_rule(SYMBOL *rule) {
-    if((*rule).refcnt < 0) {
+    if((int)REFCNT(rule) < 0) {
         fprintf(stderr, "%s\n", "Error. Reference count is negative.");
         abort();
     }
     else {
-        (*rule).refcnt = (*rule).refcnt - 1;
+        REFCNT(rule) = REFCNT(rule) - 1;
     }
 }
-
-
-
-/**
- * @brief Adds SYMBOL to the body of a rule
- * @details Adds a body symbol to the rule
- *
- * @param *bodysym The pointer to the body symbol to add the the rule.
- * @param *rule The pointer to the rule to add the body symbol to.
- * @precondition There has to be at least one value in rule
- */
-void add_body(SYMBOL *bodysym, SYMBOL *rule) {
-    (*bodysym).next = rule;
-    (*bodysym).prev = (*rule).prev;
-    (*((*bodysym).next)).prev = bodysym;
-    (*((*bodysym).prev)).next = bodysym;
-}
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -61,14 +61,14 @@ static void join_symbols(SYMBOL *this, SYMBOL *next) {
 	//    abbbc  ==> abbc   (then check for this one)
         //     ^ 
 	if(next->prev && next->next &&
-	   next->value == next->prev->value && next->value == next->next->value)
+	   next->value == PREV(next)->value && next->value == NEXT(next)->value)
 	    digram_put(next);
 	if(this->prev && this->next &&
-	   this->value == this->prev->value && this->value == this->next->value)
-	    digram_put(this);
+	   this->value == PREV(this)->value && this->value == NEXT(this)->value)
+	    digram_put(PREV(this));
     }
-    this->next = next;
-    next->prev = this;
+    SET_NEXT(this, next);
+    SET_PREV(next, this);
 }
 
 /**
@@ -81,7 +81,7 @@ static void join_symbols(SYMBOL *this, SYMBOL *next) {
 void insert_after(SYMBOL *this, SYMBOL *next) {
     debug("Insert symbol <%lu> after %s%lu%s", SYMBOL_INDEX(next),
 	  IS_RULE_HEAD(this) ? "[" : "<", SYMBOL_INDEX(this), IS_RULE_HEAD(this) ? "]" : ">");
-    join_symbols(next, this->next);
+    join_symbols(next, NEXT(this));
     join_symbols(this, next);
 }
 
@@ -98,7 +98,7 @@ static void delete_symbol(SYMBOL *this) {
 	abort();
     }
     // Splice the symbol out, deleting the digram headed by the neighbor to the left.
-    join_symbols(this->prev, this->next);
+    join_symbols(PREV(this), NEXT(this));
 
     // Delete the digram formed by the deleted node and its neighbor to the right.
     digram_delete(this);
@@ -106,7 +106,7 @@ static void delete_symbol(SYMBOL *this) {
     // If the deleted node is a nonterminal, decrement the reference count of
     // the associated rule.
     if(IS_NONTERMINAL(this))
-	unref_rule(this->rule);
+	unref_rule(RULE(this));
 
     // Recycle the deleted symbol for re-use.
     recycle_symbol(this);
@@ -118,17 +118,17 @@ static void delete_symbol(SYMBOL *this) {
  * @param this  The unique nonterminal symbol that refers to the rule to be deleted.
  */
 static void expand_instance(SYMBOL *this) {
-    SYMBOL *rule = this->rule;
+    SYMBOL *rule = RULE(this);
     debug("Expand last instance of underutilized rule [%lu] for %d",
 	   SYMBOL_INDEX(rule), rule->value);
-    if(rule->refcnt != 1) {
+    if(REFCNT(rule) != 1) {
 	fprintf(stderr, "Attempting to delete a rule with multiple references!\n");
 	abort();
     }
-    SYMBOL *left = this->prev;
-    SYMBOL *right = this->next;
-    SYMBOL *first = rule->next;
-    SYMBOL *last = rule->prev;
+    SYMBOL *left = PREV(this);
+    SYMBOL *right = NEXT(this);
+    SYMBOL *first = NEXT(rule);
+    SYMBOL *last = PREV(rule);
 
     // We are destroying any digram that starts at this symbol,
     // so we have to delete that from the table.
@@ -137,7 +137,7 @@ static void expand_instance(SYMBOL *this) {
     // Splice the body of the rule in place of the nonterminal symbol.
     join_symbols(left, first);
     join_symbols(last, right);
-    rule->next = rule->prev = NULL;  // Avoid mysterious problems.
+    rule->next = rule->prev = 0;  // Avoid mysterious problems.
 
     // The insertion of the sequence forms potentially new digrams at the beginning
     // and the end of the inserted sequence.  It is definitely necessary to insert
@@ -151,9 +151,9 @@ static void expand_instance(SYMBOL *this) {
     // digrams, except in the case of triples.
 
     // This is what the reference code does, but without the defensive checks.
-    if(!IS_RULE_HEAD(last->next)) {
+    if(!IS_RULE_HEAD(NEXT(last))) {
 	if(digram_put(last) == 1) {
-	    if(last->value != last->next->value) {
+	    if(last->value != NEXT(last)->value) {
 		fprintf(stderr, "Already existing digram not part of a triple "
 			"in expand_instance (case 1)\n");
 		abort();
@@ -162,10 +162,10 @@ static void expand_instance(SYMBOL *this) {
     }
 
     // This case never seems to occur, but I do not understand why.
-    if(!IS_RULE_HEAD(first->prev)) {
+    if(!IS_RULE_HEAD(PREV(first))) {
 	fprintf(stderr, "!!! expand_instance case 2 triggered\n");
-	if(digram_put(first->prev) == 1) {
-	    if(first->prev->value != first->value) {
+	if(digram_put(PREV(first)) == 1) {
+	    if(PREV(first)->value != first->value) {
 		fprintf(stderr, "Already existing digram not part of a triple "
 			"in expand_instance (case 2)\n");
 		abort();
@@ -191,12 +191,12 @@ static void expand_instance(SYMBOL *this) {
 static void replace_digram(SYMBOL *this, SYMBOL *rule) {
     debug("Replace digram <%lu> using rule [%lu] for %d",
 	  SYMBOL_INDEX(this), SYMBOL_INDEX(rule), rule->value);
-    SYMBOL *prev = this->prev;
+    SYMBOL *prev = PREV(this);
 
     // Delete the two nodes of the digram headed by "this", handling the removal
     // of any digrams that are thereby destroyed.
-    delete_symbol(prev->next);
-    delete_symbol(prev->next);
+    delete_symbol(NEXT(prev));
+    delete_symbol(NEXT(prev));
 
     // Create a new nonterminal symbol that refers to the head of the rule
     // and insert it in place of the original digram.
@@ -216,7 +216,7 @@ static void replace_digram(SYMBOL *this, SYMBOL *rule) {
     // have to check the digram starting at prev->next, which is still headed by the
     // nonterminal we just inserted.
     if(!check_digram(prev)) {
-	check_digram(prev->next);
+	check_digram(NEXT(prev));
     }
 }
 
@@ -232,12 +232,12 @@ static void process_match(SYMBOL *this, SYMBOL *match) {
 	  SYMBOL_INDEX(this), SYMBOL_INDEX(match));
     SYMBOL *rule = NULL; 
 
-    if(IS_RULE_HEAD(match->prev) && IS_RULE_HEAD(match->next->next)) {
+    if(IS_RULE_HEAD(PREV(match)) && IS_RULE_HEAD(NEXT(NEXT(match)))) {
 	// If the digram headed by match constitutes the entire right-hand side
 	// of a rule, then we don't create any new rule.  Instead we use the
 	// existing rule to replace_digram for the newly inserted digram.
-	rule = match->prev->rule;
-	replace_digram(this, match->prev->rule);
+	rule = RULE(PREV(match));
+	replace_digram(this, RULE(PREV(match)));
     } else {
 	// Otherwise, we create a new rule.
 	// Note that only one digram is created by this rule, and the insert_after
@@ -245,10 +245,10 @@ static void process_match(SYMBOL *this, SYMBOL *match) {
 	// In fact, no digrams will be deleted during the construction of
 	// the new rule because the calls are being made in such a way that we are
 	// never overwriting any pointers that were previously non-NULL.
-	rule = new_rule(next_nonterminal_value++);
+	rule = new_rule(new_rule_value());
 	add_rule(rule);
-	insert_after(rule->prev, new_symbol(this->value, this->rule));
-	insert_after(rule->prev, new_symbol(this->next->value, this->next->rule));
+	insert_after(PREV(rule), new_symbol(this->value, RULE(this)));
+	insert_after(PREV(rule), new_symbol(NEXT(this)->value, RULE(NEXT(this))));
 
 	// Now, replace the two existing instances of the right-hand side of the
 	// rule by nonterminals that refer to the rule.
@@ -268,7 +268,7 @@ static void process_match(SYMBOL *this, SYMBOL *match) {
 	// we are about to insert here, because, the right-hand sides of any of these
 	// other rules must contain the new nonterminal that is at the head of the
 	// current rule but not in the body of the current rule.
-	digram_put(rule->next);
+	digram_put(NEXT(rule));
     }
 
     // We have now restored the "no repeated digram" property, but it might be that
@@ -288,17 +288,17 @@ static void process_match(SYMBOL *this, SYMBOL *match) {
     // This is probably the most subtle point in the entire algorithm, which requires
     // substantial head-scratching to understand.
 
-    SYMBOL *tocheck = rule->next->rule;  // The first symbol of the just-added rule.
+    SYMBOL *tocheck = RULE(NEXT(rule));  // The first symbol of the just-added rule.
     if(tocheck) {
 	debug("Checking reference count for rule [%lu] => %d",
-	      SYMBOL_INDEX(tocheck), tocheck->refcnt);
-	if(tocheck->refcnt < 2) {
-	    if(tocheck->refcnt == 0) {
+	      SYMBOL_INDEX(tocheck), REFCNT(tocheck));
+	if(REFCNT(tocheck) < 2) {
+	    if(REFCNT(tocheck) == 0) {
 		// There is at least one reference in the just-added rule.
 		fprintf(stderr, "Reference count should not be zero!\n");
 		abort();
 	    }
-	    expand_instance(rule->next);
+	    expand_instance(NEXT(rule));
 	}
     }
 }
@@ -319,17 +319,17 @@ static void process_match(SYMBOL *this, SYMBOL *match) {
 int check_digram(SYMBOL *this) {
     debug("Check digram <%lu> for a match", SYMBOL_INDEX(this));
 
-    if (this == NULL || this->next == NULL) {
+    if (this == NULL || this->next == 0) {
         return 0;
     }
     // If the "digram" is actually a single symbol at the beginning or
     // end of a rule, then there is no need to do anything.
-    if(IS_RULE_HEAD(this) || IS_RULE_HEAD(this->next))
+    if(IS_RULE_HEAD(this) || IS_RULE_HEAD(NEXT(this)))
 	return 0;
 
     // Otherwise, look up the digram in the digram table, to see if there is
     // a matching instance.
-    SYMBOL *match = digram_get(this->value, this->next->value);
+    SYMBOL *match = digram_get(this->value, NEXT(this)->value);
     if(match == NULL) {
         // The digram did not previously exist -- insert it now.
 	digram_put(this);
@@ -339,7 +339,7 @@ int check_digram(SYMBOL *this) {
     // If the existing digram overlaps the one we are checking, then what we have
     // is a triple, like aaa.  In this case, we do not replace it because the resulting
     // rule would only be used once.
-    if(match->next == this) {
+    if(NEXT(match) == this) {
 	return 0;
     } else {
 	process_match(this, match);
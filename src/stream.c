@@ -0,0 +1,341 @@
+#include <string.h>
+
+#include "const.h"
+#include "sequitur.h"
+#include "libsequitur.h"
+#include "debug.h"
+
+/*
+ * Streaming compression and decompression (see libsequitur.h).
+ *
+ * An encoder collects the bytes pushed into it until it has a whole block of
+ * bsize bytes, which it compresses just as compress() does; a piece of input
+ * that holds whole blocks of its own is compressed where it lies.  A decoder
+ * collects the transmission until it has a whole block, from SOB to EOB, which
+ * it expands just as parallel decompression expands a block that it has found
+ * with its pre-scan.  Either way the output goes to an OUTBUF that collects it
+ * in memory, from which it is pulled.
+ *
+ * Everything runs in the context of the stream, which is made current for the
+ * duration of each call, so a stream does not disturb the context of the
+ * calling thread.
+ */
+
+/* Where a decoder is in the transmission. */
+#define DECODE_START 0     // Before SOT
+#define DECODE_BETWEEN 1   // After SOT or a block: SOB or EOT is next
+#define DECODE_BLOCK 2     // After SOB: collecting the block
+#define DECODE_END 3       // After EOT
+#define DECODE_ERROR 4     // The transmission is malformed
+
+struct seq_stream {
+    SEQ_CONTEXT *context;      // Context the stream runs in
+    int bsize;                 // Block size of an encoder, or 0 for a decoder
+    unsigned char *input;      // Input not used yet
+    size_t input_length;       // Number of bytes of input not used yet
+    size_t input_capacity;     // Size of the input buffer
+    OUTBUF output;             // Output not pulled yet, from output_pos on
+    size_t output_pos;         // Number of bytes of output pulled
+    int state;                 // Where a decoder is (DECODE_*)
+    size_t scanned;            // Number of bytes of input that a decoder has scanned
+    int continuation;          // Continuation bytes still to come in the symbol scanned
+    int finished;              // Nonzero once seq_finish() has been called
+    int error;                 // Nonzero once something has gone wrong
+};
+
+/**
+ * Create a stream of either kind.
+ *
+ * @param bsize  The block size of an encoder, or 0 for a decoder.
+ * @param capacity  The initial size of the input buffer.
+ * @return  The stream, or NULL if there is not enough memory.
+ */
+static SEQ_STREAM *new_stream(int bsize, size_t capacity) {
+    SEQ_STREAM *s = calloc(1, sizeof(SEQ_STREAM));
+    if(s == NULL) {
+        return NULL;
+    }
+    s->bsize = bsize;
+    s->input_capacity = capacity;
+    s->input = malloc(capacity);
+    s->context = new_context();
+    if(s->input == NULL || s->context == NULL || outbuf_open(&s->output, NULL) == EOF) {
+        seq_free(s);
+        return NULL;
+    }
+    s->state = DECODE_START;
+    return s;
+}
+
+/**
+ * Create an encoder, which compresses into blocks of at most bsize bytes.
+ *
+ * @param bsize  The block size, in bytes.
+ * @return  The encoder, or NULL if the block size is not valid or there is not
+ * enough memory.
+ */
+SEQ_STREAM *seq_new_encoder(int bsize) {
+    // Include helpers
+    int compressReserve(int bsize);
+
+    if(bsize < 1 || bsize > BLOCKSIZE_MAX << 10) {
+        return NULL;
+    }
+    SEQ_STREAM *s = new_stream(bsize, bsize);
+    if(s == NULL) {
+        return NULL;
+    }
+    SEQ_CONTEXT *prev = use_context(s->context);
+    if(compressReserve(bsize) || outbuf_putc(&s->output, 0x81) == EOF) { // SOT
+        use_context(prev);
+        seq_free(s);
+        return NULL;
+    }
+    use_context(prev);
+    return s;
+}
+
+/**
+ * Create a decoder.
+ *
+ * @return  The decoder, or NULL if there is not enough memory.
+ */
+SEQ_STREAM *seq_new_decoder(void) {
+    return new_stream(0, INBUF_SIZE);
+}
+
+/**
+ * Free a stream, together with any output that has not been pulled.
+ *
+ * @param s  The stream, or NULL.
+ */
+void seq_free(SEQ_STREAM *s) {
+    if(s == NULL) {
+        return;
+    }
+    free_context(s->context);
+    free(s->input);
+    free(s->output.data);
+    free(s);
+}
+
+/**
+ * Push input into an encoder, compressing each block as it is completed.
+ *
+ * @return 0 if successful, otherwise EOF.
+ */
+static int encode(SEQ_STREAM *s, const unsigned char *data, size_t length) {
+    // Include helpers
+    int compressWindow(unsigned char *data, size_t length, OUTBUF *out);
+
+    size_t bsize = s->bsize;
+    while(length > 0) {
+        if(s->input_length == 0 && length >= bsize) {
+            // compressWindow() only reads the block.
+            if(compressWindow((unsigned char *)data, bsize, &s->output) == EOF) {
+                return EOF;
+            }
+            data += bsize;
+            length -= bsize;
+            continue;
+        }
+        size_t n = bsize - s->input_length < length ? bsize - s->input_length : length;
+        memcpy(s->input + s->input_length, data, n);
+        s->input_length += n;
+        data += n;
+        length -= n;
+        if(s->input_length == bsize) {
+            if(compressWindow(s->input, bsize, &s->output) == EOF) {
+                return EOF;
+            }
+            s->input_length = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Expand a block of the transmission into the output of a decoder.
+ *
+ * @param block  The block, from just after its SOB up to and including its EOB.
+ * @param length  The number of bytes in the block.
+ * @return 0 if successful, otherwise EOF.
+ */
+static int decodeBlock(SEQ_STREAM *s, unsigned char *block, size_t length) {
+    // Include helpers
+    int init_grammar(void);
+    int readBlockData(INBUF *in);
+    int mapBodyRules(OUTBUF *out);
+
+    if(init_grammar()) {
+        return EOF;
+    }
+    INBUF in;
+    inbuf_memory(&in, block, length);
+    if(!readBlockData(&in) || !mapBodyRules(&s->output) || inbuf_getc(&in) != EOF) {
+        return EOF;
+    }
+    return 0;
+}
+
+/**
+ * Push input into a decoder, expanding each block as it is completed.  Blocks are
+ * found with scanForEOB(), as by the pre-scan of parallel decompression.
+ *
+ * @return 0 if successful, otherwise EOF.
+ */
+static int decode(SEQ_STREAM *s, const unsigned char *data, size_t length) {
+    // Include helpers
+    unsigned char *scanForEOB(unsigned char *p, unsigned char *end, int *pending);
+
+    if(s->input_length + length > s->input_capacity) {
+        size_t capacity = s->input_capacity;
+        while(capacity < s->input_length + length) {
+            capacity *= 2;
+        }
+        unsigned char *input = realloc(s->input, capacity);
+        if(input == NULL) {
+            return EOF;
+        }
+        s->input = input;
+        s->input_capacity = capacity;
+    }
+    memcpy(s->input + s->input_length, data, length);
+    s->input_length += length;
+
+    unsigned char *start = s->input;
+    unsigned char *end = s->input + s->input_length;
+    unsigned char *p = start; // Start of the input not used yet
+    while(s->state != DECODE_ERROR && p < end) {
+        if(s->state == DECODE_START) {
+            s->state = *p++ == 0x81 ? DECODE_BETWEEN : DECODE_ERROR; // SOT
+        }
+        else if(s->state == DECODE_BETWEEN) {
+            int byte = *p++;
+            if(byte == 0x83) { // SOB
+                s->state = DECODE_BLOCK;
+                s->scanned = p - start;
+                s->continuation = 0;
+            }
+            else {
+                s->state = byte == 0x82 ? DECODE_END : DECODE_ERROR; // EOT
+            }
+        }
+        else if(s->state == DECODE_BLOCK) {
+            unsigned char *q = scanForEOB(start + s->scanned, end, &s->continuation);
+            if(q == NULL) {
+                s->scanned = end - start;
+                break;
+            }
+            s->scanned = q - start;
+            debug("Decoding block of %zu bytes", (size_t)(q - p));
+            s->state = decodeBlock(s, p, q - p) == EOF ? DECODE_ERROR : DECODE_BETWEEN;
+            p = q;
+        }
+        else {
+            s->state = DECODE_ERROR; // Something after EOT
+        }
+    }
+
+    // Keep what is left for the next time.
+    if(p != start) {
+        s->input_length = end - p;
+        s->scanned -= p - start;
+        memmove(s->input, p, s->input_length);
+    }
+    return s->state == DECODE_ERROR ? EOF : 0;
+}
+
+/**
+ * Push input into a stream: bytes to be compressed into an encoder, or the next
+ * piece of a transmission into a decoder.
+ *
+ * @param s  The stream.
+ * @param data  The input.
+ * @param length  The number of bytes of input, which may be 0.
+ * @return 0 if successful, otherwise EOF, which means that a decoder has found
+ * the transmission to be malformed, that there is not enough memory, or that
+ * seq_finish() has already been called.  A stream that has failed once keeps
+ * failing, but the output produced before the failure can still be pulled.
+ */
+int seq_update(SEQ_STREAM *s, const void *data, size_t length) {
+    if(s->error || s->finished) {
+        s->error = 1;
+        return EOF;
+    }
+    SEQ_CONTEXT *prev = use_context(s->context);
+    int ret = s->bsize ? encode(s, data, length) : decode(s, data, length);
+    use_context(prev);
+    if(ret == EOF) {
+        s->error = 1;
+    }
+    return ret;
+}
+
+/**
+ * Mark the end of the input of a stream.  An encoder compresses the last block,
+ * if there is one, and ends the transmission; a decoder checks that the whole
+ * transmission has been seen.
+ *
+ * @param s  The stream.
+ * @return 0 if successful, otherwise EOF.
+ */
+int seq_finish(SEQ_STREAM *s) {
+    // Include helpers
+    int compressWindow(unsigned char *data, size_t length, OUTBUF *out);
+
+    if(s->error || s->finished) {
+        s->error = 1;
+        return EOF;
+    }
+    s->finished = 1;
+    int ret = 0;
+    if(s->bsize) {
+        SEQ_CONTEXT *prev = use_context(s->context);
+        if(s->input_length > 0) {
+            ret = compressWindow(s->input, s->input_length, &s->output);
+            s->input_length = 0;
+        }
+        if(ret != EOF) {
+            ret = outbuf_putc(&s->output, 0x82); // EOT
+        }
+        use_context(prev);
+    }
+    else if(s->state != DECODE_END) {
+        ret = EOF; // The transmission was cut short.
+    }
+    if(ret == EOF) {
+        s->error = 1;
+        return EOF;
+    }
+    return 0;
+}
+
+/**
+ * Pull output from a stream.
+ *
+ * @param s  The stream.
+ * @param buffer  Where the output is to be put.
+ * @param size  The number of bytes that fit in the buffer.
+ * @return  The number of bytes put in the buffer, which is 0 only if there is no
+ * output waiting.
+ */
+size_t seq_pull(SEQ_STREAM *s, void *buffer, size_t size) {
+    size_t n = s->output.length - s->output_pos;
+    if(n > size) {
+        n = size;
+    }
+    memcpy(buffer, s->output.data + s->output_pos, n);
+    s->output_pos += n;
+    if(s->output_pos == s->output.length) {
+        s->output.length = 0;
+        s->output_pos = 0;
+    }
+    else if(s->output_pos > s->output.length / 2) {
+        // Make room at the end without growing the buffer.
+        memmove(s->output.data, s->output.data + s->output_pos, s->output.length - s->output_pos);
+        s->output.length -= s->output_pos;
+        s->output_pos = 0;
+    }
+    return n;
+}
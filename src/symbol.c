@@ -1,17 +1,96 @@
+#include <limits.h>
+
 #include "const.h"
 #include "sequitur.h"
 
 /*
  * Symbol management.
  *
- * The functions here manage a statically allocated array of SYMBOL structures,
- * together with a stack of "recycled" symbols.
+ * The functions here manage chunked storage of SYMBOL structures, together
+ * with a stack of "recycled" symbols.
  */
 
 /*
- * Initialization of this global variable that could not be performed in the header file.
+ * Top of the stack of recycled symbols, in the current context.  The stack is
+ * intrusive: recycled symbols are chained together through their "next" fields,
+ * so pushing and popping are constant time and need no storage beyond the
+ * symbols themselves.
  */
-int next_nonterminal_value = FIRST_NONTERMINAL;
+#define recycled_symbols (seq_context->recycled_symbols)
+
+/* Number of entries in symbol_chunks.  Entries for chunks not yet allocated are NULL. */
+#define symbol_chunk_slots (seq_context->symbol_chunk_slots)
+
+/**
+ * Make sure that the chunk directory has an entry for a given number of chunks.
+ *
+ * @param slots  The number of entries needed.
+ * @return 0 on success, -1 if the directory could not be enlarged.
+ */
+static int grow_chunk_directory(int slots) {
+    if(slots <= symbol_chunk_slots) {
+        return 0;
+    }
+
+    SYMBOL **chunks = realloc(symbol_chunks, slots * sizeof(SYMBOL *));
+    if(chunks == NULL) {
+        return -1;
+    }
+    int count = symbol_chunk_slots;
+    while(count < slots) {
+        *(chunks + count) = NULL;
+        count++;
+    }
+    symbol_chunks = chunks;
+    symbol_chunk_slots = slots;
+    return 0;
+}
+
+/**
+ * Make sure that the chunk holding a given symbol has been allocated.
+ * The chunk is aligned and numbered as SYMBOL_CHUNK_BASE and SYMBOL_INDEX expect.
+ *
+ * @param index  The number of the symbol.
+ * @return 0 on success, -1 if the chunk could not be allocated.
+ */
+static int add_symbol_chunk(int index) {
+    int chunk = index >> SYMBOL_CHUNK_BITS;
+    if(chunk >= symbol_chunk_slots) {
+        // Double the directory, so that it is enlarged only a few times per run.
+        int slots = symbol_chunk_slots ? symbol_chunk_slots : 1;
+        while(slots <= chunk) {
+            slots *= 2;
+        }
+        if(grow_chunk_directory(slots)) {
+            return -1;
+        }
+    }
+    if(*(symbol_chunks + chunk) == NULL) {
+        void *base;
+        if(posix_memalign(&base, SYMBOL_CHUNK_ALIGN, (SYMBOL_CHUNK + 1) * sizeof(SYMBOL))) {
+            return -1;
+        }
+        ((SYMBOL *)base + SYMBOL_CHUNK)->value = chunk;
+        *(symbol_chunks + chunk) = base;
+    }
+    return 0;
+}
+
+/**
+ * Prepare symbol storage for a given number of symbols.
+ * Storage grows by itself as symbols are allocated, so this is only a hint:
+ * it sizes the chunk directory up front and allocates the first chunk, while
+ * the other chunks are still allocated as they are first used.
+ *
+ * @param count  The number of symbols that are expected to be needed.
+ * @return 0 on success, -1 if the storage could not be allocated.
+ */
+int reserve_symbols(int count) {
+    if(grow_chunk_directory((int)(((long)count + SYMBOL_CHUNK - 1) >> SYMBOL_CHUNK_BITS))) {
+        return -1;
+    }
+    return add_symbol_chunk(0);
+}
 
 /**
  * Initialize the symbols module.
@@ -19,10 +98,12 @@ int next_nonterminal_value = FIRST_NONTERMINAL;
  * to FIRST_NONTERMINAL;
  */
 void init_symbols(void) {
-    // TODO - Free all symbols
-    // Setting the pointer back to zero will in a way free all symbols
+    // Symbols are not freed one at a time: storage is simply reused from the start.
     num_symbols = 0;
     next_nonterminal_value = FIRST_NONTERMINAL;
+
+    // Anything on the recycle stack lives in the storage that was just freed.
+    recycled_symbols = NULL;
 }
 
 /**
@@ -34,20 +115,18 @@ void init_symbols(void) {
  * (i.e. >= FIRST_NONTERMINAL).
  * @param rule  For a terminal symbol, this parameter should be NULL.  For a nonterminal
  * symbol, this parameter can be used to specify a rule having that nonterminal at its head.
- * In that case, the reference count of the rule is increased by one and a pointer to the rule
- * is stored in the symbol.  This parameter can also be NULL for a nonterminal symbol if the
- * associated rule is not currently known and will be assigned later.
- * @return  A pointer to the new symbol, whose value and rule fields have been initialized
- * according to the parameters passed, and with other fields zeroed.  If the symbol storage
+ * In that case, the reference count of the rule is increased by one.  The symbol refers to
+ * whatever rule has a head with its value, so this parameter can also be NULL for a
+ * nonterminal symbol if the associated rule is not currently known and will be created later.
+ * @return  A pointer to the new symbol, whose value field has been initialized according
+ * to the parameters passed, and with other fields zeroed.  If the symbol storage
  * is exhausted and a new symbol cannot be created, then a message is printed to stderr and
  * abort() is called.
  */
 SYMBOL *new_symbol(int value, SYMBOL *rule) {
-    // TODO: Maybe also do something with next_nonterminal_value
-
     // Include helpers
     SYMBOL *get_recycled_symbol();
-    void set_new_symbol_values(SYMBOL *sym, SYMBOL *rule, int value);
+    void set_new_symbol_values(SYMBOL *sym, int value);
 
 
     // Return null if terminal symbol and terminal is not null
@@ -58,7 +137,7 @@ SYMBOL *new_symbol(int value, SYMBOL *rule) {
     // Check for recycled symbols
     SYMBOL *sym = get_recycled_symbol();
     if(sym) {
-	set_new_symbol_values(sym, rule, value);
+	set_new_symbol_values(sym, value);
 	if(rule != NULL) {
 	    ref_rule(rule);
 	}
@@ -67,13 +146,18 @@ SYMBOL *new_symbol(int value, SYMBOL *rule) {
         return sym;
     }
 
-    if (num_symbols >= MAX_SYMBOLS) {
-        abort();
+    // Storage grows one chunk at a time; only running out of memory is fatal.
+    int chunk = num_symbols >> SYMBOL_CHUNK_BITS;
+    if(chunk >= symbol_chunk_slots || *(symbol_chunks + chunk) == NULL) {
+        if(num_symbols == INT_MAX || add_symbol_chunk(num_symbols)) {
+            fprintf(stderr, "symbol storage exhausted (%d symbols)\n", num_symbols);
+            abort();
+        }
     }
 
-    // Get the space from symbol_storage
-    sym = (symbol_storage + num_symbols);
-    set_new_symbol_values(sym, rule, value);
+    // Get the space from symbol storage
+    sym = SYMBOL_AT(num_symbols);
+    set_new_symbol_values(sym, value);
     if(rule != NULL) {
         ref_rule(rule);
     }
@@ -85,33 +169,29 @@ SYMBOL *new_symbol(int value, SYMBOL *rule) {
 
 /**
  * @brief Gets a recycled symbol.
+ * @details Pops the most recently recycled symbol off the recycle stack.
  *
- * @return A recycled symbol
+ * @return A recycled symbol, or NULL if the stack is empty
  */
 SYMBOL *get_recycled_symbol() {
-    for(SYMBOL *sym = symbol_storage + num_symbols - 1; sym >= symbol_storage; sym--) {
-	if((*sym).refcnt == -1) {
-	    return sym;
-	}
+    SYMBOL *sym = recycled_symbols;
+    if(sym != NULL) {
+        recycled_symbols = SYMBOL_PTR((*sym).next);
     }
-    return NULL;
+    return sym;
 }
 
 /**
  * @brief Set new symbol values as specified in the new_rule() description
- * Initialize values and rules field, zero other fields.
+ * Initialize the value field, zero other fields.
  */
-void set_new_symbol_values(SYMBOL *sym, SYMBOL *rule, int value) {
-    // Initialize value and rule
+void set_new_symbol_values(SYMBOL *sym, int value) {
+    // Initialize value
     (*sym).value = value;
-    (*sym).rule = rule;
 
     // Zero other fields.
-    (*sym).refcnt = 0;
-    (*sym).next = NULL;
-    (*sym).prev = NULL;
-    (*sym).nextr = NULL;
-    (*sym).prevr = NULL;
+    (*sym).next = 0;
+    (*sym).prev = 0;
 }
 
 /**
@@ -121,5 +201,11 @@ void set_new_symbol_values(SYMBOL *sym, SYMBOL *rule, int value) {
  * once it has been recycled.
  */
 void recycle_symbol(SYMBOL *s) {
-    (*s).refcnt = -1;
+    // Already on the recycle stack; pushing it twice would create a cycle.
+    if((*s).value == RECYCLED_VALUE) {
+        return;
+    }
+    (*s).value = RECYCLED_VALUE;
+    SET_NEXT(s, recycled_symbols);
+    recycled_symbols = s;
 }
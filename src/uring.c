@@ -0,0 +1,545 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "sequitur.h"
+#include "debug.h"
+
+/*
+ * Asynchronous file I/O with io_uring.
+ *
+ * compress() and decompress() read and write their files with one system call
+ * at a time, and each call blocks until the disk has done its part, so nothing
+ * is compressed or expanded in the meantime.  With -u, reads and writes of
+ * regular files are instead queued on an io_uring(7), URING_DEPTH of them at a
+ * time in each direction:
+ *
+ *  - Input is read ahead into a ring of buffers, so while one buffer is being
+ *    compressed (a block of bsize bytes) or decompressed (URING_CHUNK bytes),
+ *    the reads of the ones after it are already under way.
+ *  - Output is written from a ring of buffers of OUTBUF_SIZE bytes; an OUTBUF
+ *    whose buffer fills up queues a write of it and moves on to the next
+ *    buffer, only waiting if that one is still being written.
+ *
+ * Reads and writes are at explicit offsets, so only regular files take part;
+ * anything else, or a system without io_uring, is read and written as usual.
+ * The rings are set up with the raw system calls, as in io_uring_setup(2), so
+ * no library is needed.
+ */
+
+/* Number of buffers, and so of reads or writes in flight, in each direction. */
+#define URING_DEPTH 4
+
+/* Size of the buffers that the decompressor reads its input into. */
+#define URING_CHUNK (256 << 10)
+
+typedef struct request {
+    unsigned char *data;       // Buffer read into or written from
+    size_t length;             // Number of bytes to be read or written
+    size_t done;               // Number of bytes read or written so far
+    off_t offset;              // Offset in the file of the first byte
+    int pending;               // Nonzero while the request is in flight
+    int error;                 // Nonzero if the request failed
+} REQUEST;
+
+struct uring {
+    int fd;                    // The io_uring
+    int opcode;                // IORING_OP_READ or IORING_OP_WRITE
+    int file;                  // File descriptor read or written
+    off_t offset;              // Offset in the file of the next request
+    size_t size;               // Size of each buffer
+    unsigned char *buffers;    // URING_DEPTH buffers, each after INBUF_LOOKAHEAD spare bytes
+    REQUEST *requests;         // URING_DEPTH requests, one for each buffer
+    int next;                  // Request to be used next
+    int current;               // Request whose buffer an INBUF is reading, or -1
+
+    // The submission and completion queues shared with the kernel.
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+/**
+ * Queue (the rest of) a request, and hand it to the kernel.
+ *
+ * @param ur  The URING.
+ * @param i  The number of the request.
+ * @return 0 if successful, otherwise -1.
+ */
+static int uring_submit(URING *ur, int i) {
+    REQUEST *req = ur->requests + i;
+    unsigned tail = *ur->sq_tail;
+    unsigned slot = tail & *ur->sq_mask;
+    struct io_uring_sqe *sqe = ur->sqes + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ur->opcode;
+    sqe->fd = ur->file;
+    sqe->addr = (unsigned long)(req->data + req->done);
+    sqe->len = req->length - req->done;
+    sqe->off = req->offset + req->done;
+    sqe->user_data = i;
+    *(ur->sq_array + slot) = slot;
+    __atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    req->pending = 1;
+    while(syscall(__NR_io_uring_enter, ur->fd, 1, 0, 0, NULL, 0) < 0) {
+        if(errno != EINTR && errno != EAGAIN) {
+            req->pending = 0;
+            req->error = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Start reading the next part of the file into the buffer of a request.
+ *
+ * @param ur  The URING.
+ * @param i  The number of the request.
+ * @return 0 if successful, otherwise -1.
+ */
+static int uring_read(URING *ur, int i) {
+    REQUEST *req = ur->requests + i;
+    req->length = ur->size;
+    req->done = 0;
+    req->offset = ur->offset;
+    ur->offset += ur->size;
+    return uring_submit(ur, i);
+}
+
+/**
+ * Take in the requests that the kernel has completed.  A read or write that only
+ * did part of its work is queued again for the rest, unless a read reached the
+ * end of the file.
+ *
+ * @param ur  The URING.
+ */
+static void uring_complete(URING *ur) {
+    unsigned head = *ur->cq_head;
+    unsigned tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        struct io_uring_cqe *cqe = ur->cqes + (head & *ur->cq_mask);
+        REQUEST *req = ur->requests + cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+        req->pending = 0;
+        if(res == -EINTR || res == -EAGAIN) {
+            uring_submit(ur, cqe->user_data);
+        }
+        else if(res < 0 || (res == 0 && ur->opcode == IORING_OP_WRITE)) {
+            debug("io_uring request failed: %s", strerror(-res));
+            req->error = 1;
+        }
+        else if(res > 0) {
+            req->done += res;
+            if(req->done < req->length) {
+                uring_submit(ur, cqe->user_data);
+            }
+        }
+    }
+}
+
+/**
+ * Wait for a request to be done.
+ *
+ * @param ur  The URING.
+ * @param i  The number of the request.
+ * @return 0 if the request succeeded, otherwise EOF.
+ */
+static int uring_wait(URING *ur, int i) {
+    REQUEST *req = ur->requests + i;
+    uring_complete(ur);
+    while(req->pending) {
+        if(syscall(__NR_io_uring_enter, ur->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+           && errno != EINTR) {
+            return EOF;
+        }
+        uring_complete(ur);
+    }
+    return req->error ? EOF : 0;
+}
+
+/**
+ * Wait for all of the requests of a URING to be done.
+ *
+ * @param ur  The URING.
+ * @return 0 if they all succeeded, otherwise EOF.
+ */
+int uring_drain(URING *ur) {
+    int ret = 0;
+    for(int i = 0; i < URING_DEPTH; i++) {
+        if(uring_wait(ur, i) == EOF) {
+            ret = EOF;
+        }
+    }
+    return ret;
+}
+
+/**
+ * Finish with a URING, after waiting for the requests in flight.
+ *
+ * @param ur  The URING.
+ */
+static void uring_close(URING *ur) {
+    if(ur->requests != NULL) {
+        uring_drain(ur);
+    }
+    if(ur->sqes != MAP_FAILED) {
+        munmap(ur->sqes, ur->sqes_size);
+    }
+    if(ur->cq_ring != MAP_FAILED) {
+        munmap(ur->cq_ring, ur->cq_ring_size);
+    }
+    if(ur->sq_ring != MAP_FAILED) {
+        munmap(ur->sq_ring, ur->sq_ring_size);
+    }
+    close(ur->fd);
+    free(ur->buffers);
+    free(ur->requests);
+    ur->buffers = NULL;
+    ur->requests = NULL;
+}
+
+/**
+ * Set up an io_uring for reading or writing a regular file, with URING_DEPTH
+ * buffers of the given size.
+ *
+ * @param ur  The URING to be set up.
+ * @param stream  The stream of the file, from whose current position on the
+ * file is read or written.
+ * @param opcode  IORING_OP_READ or IORING_OP_WRITE.
+ * @param size  The size of each buffer.
+ * @return 0 if successful, otherwise -1, for instance if the file is not a
+ * regular file or io_uring is not available.
+ */
+static int uring_open(URING *ur, FILE *stream, int opcode, size_t size) {
+    struct stat st;
+    int file = fileno(stream);
+    if(file < 0 || fstat(file, &st) || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    off_t offset = ftello(stream);
+    if(offset < 0) {
+        return -1;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, 2 * URING_DEPTH, &params);
+    if(fd < 0) {
+        debug("io_uring is not available: %s", strerror(errno));
+        return -1;
+    }
+    memset(ur, 0, sizeof(*ur));
+    ur->fd = fd;
+    ur->sq_ring = MAP_FAILED;
+    ur->cq_ring = MAP_FAILED;
+    ur->sqes = MAP_FAILED;
+
+    // IORING_OP_READ and IORING_OP_WRITE came with the same kernel as this feature.
+    if(!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return -1;
+    }
+    ur->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ur->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ur->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sq_ring = mmap(NULL, ur->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING);
+    ur->cq_ring = mmap(NULL, ur->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_CQ_RING);
+    ur->sqes = mmap(NULL, ur->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQES);
+    ur->buffers = malloc(URING_DEPTH * (INBUF_LOOKAHEAD + size));
+    ur->requests = calloc(URING_DEPTH, sizeof(REQUEST));
+    if(ur->sq_ring == MAP_FAILED || ur->cq_ring == MAP_FAILED || ur->sqes == MAP_FAILED
+       || ur->buffers == NULL || ur->requests == NULL) {
+        uring_close(ur);
+        return -1;
+    }
+
+    unsigned char *sq = ur->sq_ring;
+    unsigned char *cq = ur->cq_ring;
+    ur->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ur->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ur->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ur->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ur->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ur->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    ur->opcode = opcode;
+    ur->file = file;
+    ur->offset = offset;
+    ur->size = size;
+    ur->current = -1;
+    for(int i = 0; i < URING_DEPTH; i++) {
+        (ur->requests + i)->data = ur->buffers + i * (INBUF_LOOKAHEAD + size) + INBUF_LOOKAHEAD;
+    }
+    return 0;
+}
+
+/**
+ * Refill an INBUF that reads through a URING (see inbuf_fill()), by moving on
+ * to the next buffer that has been read ahead.  The few bytes left in the
+ * buffer before are put in front of it, and the buffer before is reused to read
+ * ahead further.
+ *
+ * @param ib  The INBUF.
+ * @return  The number of bytes left to be read.
+ */
+size_t uring_fill(INBUF *ib) {
+    URING *ur = ib->uring;
+    size_t left = ib->end - ib->next;
+    REQUEST *req = ur->requests + ur->next;
+    if(uring_wait(ur, ur->next) == EOF || req->done == 0) {
+        // An error cuts the input short, just as with fread().
+        ib->stream = NULL;
+        return left;
+    }
+    memmove(req->data - left, ib->next, left);
+    if(ur->current != -1 && uring_read(ur, ur->current)) {
+        ib->stream = NULL;
+    }
+    if(req->done < req->length) {
+        // The end of the file.
+        ib->stream = NULL;
+    }
+    ib->data = req->data - left;
+    ib->next = ib->data;
+    ib->end = req->data + req->done;
+    ur->current = ur->next;
+    ur->next = (ur->next + 1) % URING_DEPTH;
+    return left + req->done;
+}
+
+/**
+ * Write out the buffer of an OUTBUF that writes through a URING (see
+ * outbuf_flush()).  The write is queued, and the OUTBUF moves on to the next
+ * buffer, once any write from it that is still in flight is done.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if successful, otherwise EOF.
+ */
+int uring_flush(OUTBUF *ob) {
+    URING *ur = ob->uring;
+    if(ob->length == 0) {
+        return 0;
+    }
+    REQUEST *req = ur->requests + ur->next;
+    req->length = ob->length;
+    req->done = 0;
+    req->offset = ur->offset;
+    if(uring_submit(ur, ur->next)) {
+        return EOF;
+    }
+    ur->offset += ob->length;
+    ob->total += ob->length;
+    ob->length = 0;
+    ur->next = (ur->next + 1) % URING_DEPTH;
+    if(uring_wait(ur, ur->next) == EOF) {
+        return EOF;
+    }
+    ob->data = (ur->requests + ur->next)->data;
+    return 0;
+}
+
+/**
+ * Set up an OUTBUF that writes to a regular file through a URING, or as usual if
+ * that is not possible.
+ *
+ * @param ob  The OUTBUF to be set up.
+ * @param ur  The URING to be set up; it is used only if ob->uring is set.
+ * @param stream  The stream to write to.
+ * @return 0 if successful, otherwise EOF.
+ */
+static int uring_outbuf_open(OUTBUF *ob, URING *ur, FILE *stream) {
+    if(fflush(stream) == EOF) {
+        return EOF;
+    }
+    if(uring_open(ur, stream, IORING_OP_WRITE, OUTBUF_SIZE)) {
+        return outbuf_open(ob, stream);
+    }
+    ob->stream = stream;
+    ob->fd = ur->file;
+    ob->length = 0;
+    ob->total = 0;
+    ob->capacity = OUTBUF_SIZE;
+    ob->pages = NULL;
+    ob->uring = ur;
+    ob->data = ur->requests->data;
+    return 0;
+}
+
+/**
+ * Finish with an OUTBUF set up by uring_outbuf_open(), leaving the file
+ * positioned just after the output.
+ *
+ * @param ob  The OUTBUF.
+ * @return 0 if successful, otherwise EOF.
+ */
+static int uring_outbuf_close(OUTBUF *ob) {
+    URING *ur = ob->uring;
+    int ret = outbuf_close(ob);
+    if(ur != NULL) {
+        if(fseeko(ob->stream, ur->offset, SEEK_SET)) {
+            ret = EOF;
+        }
+        uring_close(ur);
+    }
+    return ret;
+}
+
+/**
+ * Compresses a regular file as compress() does, reading blocks ahead and writing
+ * the output behind with io_uring.  Any other input, or a system without
+ * io_uring, is left to compress().
+ *
+ * @param in  The stream from which input is to be read.
+ * @param out  The stream to which the transmission is to be written.
+ * @param bsize  The maximum number of bytes read per block.
+ * @return  The number of bytes written, in case of success, otherwise EOF.
+ */
+int compress_uring(FILE *in, FILE *out, int bsize) {
+    // Include helpers
+    int compressReserve(int bsize);
+    int compressWindow(unsigned char *data, size_t length, OUTBUF *out);
+
+    if(bsize < 1) {
+        return EOF;
+    }
+    URING reads;
+    if(uring_open(&reads, in, IORING_OP_READ, bsize)) {
+        return compress(in, out, bsize);
+    }
+    if(compressReserve(bsize)) {
+        uring_close(&reads);
+        return EOF;
+    }
+    int ret = 0;
+    for(int i = 0; i < URING_DEPTH && ret != EOF; i++) {
+        ret = uring_read(&reads, i);
+    }
+
+    URING writes;
+    OUTBUF ob;
+    if(uring_outbuf_open(&ob, &writes, out) == EOF) {
+        uring_close(&reads);
+        return EOF;
+    }
+    if(ret != EOF) {
+        ret = outbuf_putc(&ob, 0x81); // SOT
+    }
+    // Each block is compressed in its buffer, which then reads the block
+    // URING_DEPTH blocks further on.  A short block is the last one.
+    off_t end = reads.offset;
+    while(ret != EOF) {
+        REQUEST *req = reads.requests + reads.next;
+        if(uring_wait(&reads, reads.next) == EOF) {
+            ret = EOF;
+            break;
+        }
+        end = req->offset + req->done;
+        if(req->done > 0) {
+            debug("Read block of %zu bytes", req->done);
+            ret = compressWindow(req->data, req->done, &ob);
+        }
+        if(req->done < req->length) {
+            break;
+        }
+        if(ret != EOF) {
+            ret = uring_read(&reads, reads.next);
+        }
+        reads.next = (reads.next + 1) % URING_DEPTH;
+    }
+    if(ret != EOF) {
+        ret = outbuf_putc(&ob, 0x82); // EOT
+    }
+    uring_close(&reads);
+    fseeko(in, end, SEEK_SET);
+
+    if(uring_outbuf_close(&ob) == EOF || ret == EOF) {
+        return EOF;
+    }
+    return ob.total > INT_MAX ? EOF : ob.total;
+}
+
+/**
+ * Decompresses a transmission as decompress() does, reading a regular input file
+ * ahead and writing a regular output file behind with io_uring.  If neither
+ * is a regular file, or io_uring is not available, the work is left to
+ * decompress().
+ *
+ * @param in  The stream from which the transmission is to be read.
+ * @param out  The stream to which the uncompressed data is to be written.
+ * @return  The number of bytes written, in case of success, otherwise EOF.
+ */
+int decompress_uring(FILE *in, FILE *out) {
+    // Include helpers
+    int decompressBlocks(INBUF *ib, OUTBUF *ob);
+
+    INBUF ib;
+    URING reads;
+    int reading = uring_open(&reads, in, IORING_OP_READ, URING_CHUNK) == 0;
+    int ret = 0;
+    for(int i = 0; reading && i < URING_DEPTH && ret != EOF; i++) {
+        ret = uring_read(&reads, i);
+    }
+    if(reading) {
+        inbuf_memory(&ib, reads.requests->data, 0);
+        ib.stream = in;
+        ib.uring = &reads;
+    }
+    else if(inbuf_open(&ib, in) == EOF) {
+        return EOF;
+    }
+
+    URING writes;
+    OUTBUF ob;
+    if(ret == EOF || uring_outbuf_open(&ob, &writes, out) == EOF) {
+        if(reading) {
+            uring_close(&reads);
+        }
+        inbuf_close(&ib);
+        return EOF;
+    }
+    if(!reading && ob.uring == NULL) {
+        inbuf_close(&ib);
+        outbuf_close(&ob);
+        return decompress(in, out);
+    }
+
+    // The output of the blocks decompressed before any error is still written out.
+    ret = decompressBlocks(&ib, &ob);
+    if(reading) {
+        // Leave the input just after the transmission, as decompress() does.
+        REQUEST *req = reads.requests + reads.current;
+        off_t position = reads.current == -1 ? reads.requests->offset
+                                             : req->offset + (ib.next - req->data);
+        uring_close(&reads);
+        fseeko(in, position, SEEK_SET);
+    }
+    inbuf_close(&ib);
+    if(uring_outbuf_close(&ob) == EOF || ret == EOF) {
+        return EOF;
+    }
+    return ob.total > INT_MAX ? EOF : ob.total;
+}
@@ -0,0 +1,274 @@
+#include "const.h"
+
+/*
+ * Command line arguments.  This file and files.c belong to the program only, so
+ * the option variables are not part of libsequitur.
+ */
+
+/* The variables set by validargs (see const.h). */
+int global_options;
+char *input_path;
+char *output_path;
+
+/**
+ * @brief Validates command line arguments passed to the program.
+ * @details This function will validate all the arguments passed to the
+ * program, returning 0 if validation succeeds and -1 if validation fails.
+ * Upon successful return, the selected program options will be set in the
+ * global variable "global_options", where they will be accessible
+ * elsewhere in the program.
+ *
+ * @param argc The number of arguments passed to the program from the CLI.
+ * @param argv The argument strings passed to the program from the CLI.
+ * @return 0 if validation succeeds and -1 if validation fails.
+ * Refer to the homework document for the effects of this function on
+ * global variables.
+ * @modifies global variable "global_options" to contain a bitmap representing
+ * the selected options.
+ */
+int validargs(int argc, char **argv) {
+    // Include helpers
+    int stringCompare(char *string1, char *string2);
+    int parseBlocksize(char *string);
+    void modifyGlobalOptions(int blocksize, char *flag);
+
+    // Variables
+    char *flagH = "-h";
+    char *flagC = "-c";
+    char *flagD = "-d";
+    char *flagB = "-b";
+    char *flagJ = "-j";
+    char *flagP = "-p";
+    char *flagU = "-u";
+    char *flagI = "-i";
+    char *flagO = "-o";
+    int defaultblocksize = 1024;
+    input_path = NULL;
+    output_path = NULL;
+
+    // Return PASS and modify global_options if -h is the first flag.
+    // There is at least 1 flag.
+    if (argc > 1 && stringCompare(flagH, *(argv + 1))) {
+        modifyGlobalOptions(defaultblocksize, flagH);
+        return 0;
+    }
+
+    // Otherwise -c or -d must be the first flag.
+    if(argc < 2) {
+        return -1;
+    }
+    char *flag = *(argv + 1);
+    int compressing = stringCompare(flagC, flag);
+    if(!compressing && !stringCompare(flagD, flag)) {
+        return -1;
+    }
+
+    // The flag may be followed by options: -b BLOCKSIZE in [1, BLOCKSIZE_MAX] (only
+    // with -c), -j JOBS in [1, JOBS_MAX], -p (only with -c), -u, and -i FILE and
+    // -o FILE.  Only one of -j, -p and -u may be given, and each at most once.
+    int blocksize = -1;
+    int jobs = -1;
+    int pipelined = 0;
+    int asynchronous = 0;
+    char *inpath = NULL;
+    char *outpath = NULL;
+    char **argp = argv + 2;
+    while(argp < argv + argc) {
+        if(compressing && stringCompare(flagP, *argp) && !pipelined) {
+            pipelined = 1;
+            argp++;
+            continue;
+        }
+        if(stringCompare(flagU, *argp) && !asynchronous) {
+            asynchronous = 1;
+            argp++;
+            continue;
+        }
+        if(argp + 1 >= argv + argc) {
+            return -1; // Option without a value
+        }
+        if(stringCompare(flagI, *argp) || stringCompare(flagO, *argp)) {
+            char **path = stringCompare(flagI, *argp) ? &inpath : &outpath;
+            if(*path != NULL) {
+                return -1;
+            }
+            *path = *(argp + 1);
+            argp += 2;
+            continue;
+        }
+        int value = parseBlocksize(*(argp + 1));
+        if(value == -1) {
+            return -1;
+        }
+        if(compressing && stringCompare(flagB, *argp) && blocksize == -1) {
+            blocksize = value;
+        }
+        else if(stringCompare(flagJ, *argp) && jobs == -1 && value <= JOBS_MAX) {
+            jobs = value;
+        }
+        else {
+            return -1;
+        }
+        argp += 2;
+    }
+    if(pipelined + asynchronous + (jobs != -1) > 1) {
+        return -1;
+    }
+
+    modifyGlobalOptions(blocksize != -1 ? blocksize : defaultblocksize, flag);
+    if(jobs != -1) {
+        global_options |= jobs << 8;
+    }
+    if(pipelined) {
+        global_options |= 0x8;
+    }
+    if(asynchronous) {
+        global_options |= 0x10;
+    }
+    input_path = inpath;
+    output_path = outpath;
+    return 0;
+}
+
+/**
+ * @brief Modifies global_options.
+ * @details Modifies global_options based on the given blocksize and flag.
+ *
+ * @param blocksize The blocksize of global_options
+ * @param flag The flag
+ */
+void modifyGlobalOptions(int blocksize, char *flag) {
+    // Include helper functions
+    int stringCompare(char *string1, char *string2);
+
+    int temp = 0;
+    int flagbit = 0;
+    if(stringCompare("-h", flag)) {
+        flagbit = 0x1; // 0b0001
+        temp = flagbit;
+    }
+    else if(stringCompare("-c", flag)) {
+        flagbit = 0x2; // 0b0010
+        temp = (int)((unsigned int)blocksize << 16);
+        temp = temp | flagbit;
+    }
+    else if(stringCompare("-d", flag)) {
+        flagbit = 0x4; // 0b0100
+        temp = flagbit;
+    }
+    global_options = temp;
+}
+
+/**
+ * @brief Parses a given blocksize string and returns an integer.
+ * @details This function will parse a given blocksize string and determine
+ * if it is valid or not. If the string is valid, it returns the integer size,
+ * otherwise, it returns -1.
+ *
+ * @param string Pointer to the string
+ * @return The blocksize if successful, -1 if it is not a valid
+ * blocksize.
+ */
+int parseBlocksize(char *string) {
+    // Include helpers
+    int stringLength(char *string);
+
+    // Constants
+    int fail = -1;
+    int number = 0;
+    int loopCounter = 1;
+    char zero = '0';
+    char nine = '9';
+
+    // Get the last index of the string array.
+    int index = stringLength(string);
+    index--;
+
+    // Loop to construct integer value.
+    while(index >= 0) {
+        char c = *(string + index);
+        if(c < zero || c > nine) {
+            // Return FAIL if not a number character.
+            return fail;
+        }
+        else if(loopCounter > 10000) {
+            // Return FAIL if leading characters are not zeros
+            if(c != zero) {
+                return fail;
+            }
+        }
+        else if(loopCounter <= 10000) {
+            // Change into integer and add to number.
+            c = c - 48; // Ex. '0' = 48; 48 - 48 = 0; The 'real' number.
+            number = number + (c * loopCounter); // Ex. 0 = 0 + (0 * 1);
+            loopCounter = loopCounter * 10; // Ex. loopCounter = 10;
+        }
+        index--;
+    }
+
+    // Range of current number is [0-99999]
+    if(number < 1 || number > BLOCKSIZE_MAX) {
+        // Return FAIL if number is not in correct range.
+        return fail;
+    }
+    return number;
+}
+
+/**
+ * @brief Returns the length of the given string.
+ *
+ * @param string Pointer to the string.
+ * @return The length of the string.
+ */
+int stringLength(char *string) {
+    int nullTerm = '\0';
+    int length = 0;
+
+    while(*string != nullTerm) {
+        length++;
+        string++;
+    }
+    return length;
+}
+
+/**
+ * @brief Compares 2 strings and checks if they are equal.
+ * @details This function will compare 2 strings passed in as arguments,
+ * returning 1 if strings are equal and 0 if strings are not equal.
+ *
+ * @param string1 Pointer to the first string.
+ * @param string2 Pointer to the second string.
+ * @return 1 if the strings are equal and 0 if the strings are not equal.
+ */
+int stringCompare(char *string1, char *string2) {
+    // Variables
+    char nullTerm = '\0';
+    int pass = 1;
+    int fail = 0;
+
+    while(1) {
+        if(*string1 == nullTerm && *string2 == nullTerm) {
+            // Return at the end of the string.
+            // Matched args.
+            return pass;
+        }
+        else if(*string1 == nullTerm || *string2 == nullTerm) {
+            // Return when one string is longer than the other.
+            // Unmatched args.
+            return fail;
+        }
+        else if(*string1 != *string2) {
+            // Return when characters at different.
+            // Unmatched args.
+            return fail;
+        }
+        else {
+            // Increment pointers by size of char
+            string1++;
+            string2++;
+        }
+    }
+
+    // Function never reaches here.
+    return pass;
+}
\ No newline at end of file
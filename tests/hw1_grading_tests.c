@@ -22,15 +22,24 @@
 
 #define ASSERT_SYMBOL_STRUCT do { \
     cr_assert_eq(ret_symbol->value, exp_symbol.value, "returned symbol has incorrect value field! Got: %d | Exp: %d", ret_symbol->value, exp_symbol.value); \
-    cr_assert_eq(ret_symbol->rule, exp_symbol.rule, "returned symbol has incorrect rule field! Got: %p | Exp: %p", ret_symbol->rule, exp_symbol.rule); \
-    cr_assert_eq(ret_symbol->refcnt, exp_symbol.refcnt, "returned symbol has incorrect refcnt field! Got: %d | Exp: %d", ret_symbol->refcnt, exp_symbol.refcnt); \
-    cr_assert_eq(ret_symbol->next, exp_symbol.next, "returned symbol has incorrect next field! Got: %p | Exp: %p", ret_symbol->next, exp_symbol.next); \
-    cr_assert_eq(ret_symbol->prev, exp_symbol.prev, "returned symbol has incorrect prev field! Got: %p | Exp: %p", ret_symbol->prev, exp_symbol.prev); \
-    cr_assert_eq(ret_symbol->nextr, exp_symbol.nextr, "returned symbol has incorrect nextr field! Got: %p | Exp: %p", ret_symbol->nextr, exp_symbol.nextr); \
-    cr_assert_eq(ret_symbol->prevr, exp_symbol.prevr, "returned symbol has incorrect prevr field! Got: %p | Exp: %p", ret_symbol->prevr, exp_symbol.prev); \
+    cr_assert_eq(ret_symbol->next, exp_symbol.next, "returned symbol has incorrect next field! Got: %u | Exp: %u", ret_symbol->next, exp_symbol.next); \
+    cr_assert_eq(ret_symbol->prev, exp_symbol.prev, "returned symbol has incorrect prev field! Got: %u | Exp: %u", ret_symbol->prev, exp_symbol.prev); \
 } while(0)
 
 
+/* Store a digram in a given slot of digram_table, along with its (stamped) key. */
+#define SET_DIGRAM_SLOT(index, digram) do { \
+    digram_table[index].key = DIGRAM_STAMP(DIGRAM_KEY((digram)->value, \
+                                           NEXT(digram) ? NEXT(digram)->value : 0)); \
+    digram_table[index].first = (digram); \
+} while(0)
+
+/* Make a slot of digram_table unused. */
+#define CLEAR_DIGRAM_SLOT(index) do { \
+    digram_table[index].key = 0; \
+    digram_table[index].first = NULL; \
+} while(0)
+
 #define COMPARE_OUTPUT(output, reference, exp_ret)				\
     run_with_system("cmp "STUDENT_OUTPUT"/"output" "TEST_INPUT"/"reference, exp_ret);
 
@@ -286,6 +295,19 @@ Test(validargs_suite, validargs_12, .timeout=TEST_TIMEOUT) {
     ASSERT_GLOBAL_OPTIONS;
 }
 
+/*
+ * The low-level unit tests use symbol storage and the digram table directly,
+ * so give them the storage a run with no size information would get.
+ */
+static void reserve_default_storage(void) {
+    reserve_symbols(MAX_SYMBOLS);
+    reserve_digrams(MAX_SYMBOLS);
+}
+
+TestSuite(symbols_suite, .init=reserve_default_storage);
+TestSuite(rules_suite, .init=reserve_default_storage);
+TestSuite(digram_suite, .init=reserve_default_storage);
+
 /**
  * ================================
  * PART II
@@ -310,19 +332,20 @@ Test(symbols_suite, init_symbols, .timeout=TEST_TIMEOUT) {
 
 /**
  * init_rules
- * @brief checks if init_rules properly nulls out the main_rule and resets rule_map
+ * @brief checks if init_rules properly nulls out the main_rule and removes the heads of rules
  */
 Test(rules_suite, init_rules, .timeout=TEST_TIMEOUT) {
     SYMBOL temp = {0};
     main_rule = &temp;
-    memset(rule_map, 'A', MAX_SYMBOLS * sizeof(SYMBOL *));
+    map_rule(new_symbol(FIRST_NONTERMINAL, NULL)); // The table is allocated by the first rule.
+    memset(rule_data, 'A', (SYMBOL_VALUE_MAX + 1) * sizeof(RULE_DATA));
 
     init_rules();
 
     cr_assert_null(main_rule, "main_rule was not set to NULL!");
     int i;
-    for(i = 0; i < MAX_SYMBOLS; i++) {
-        cr_assert_null(rule_map[i], "rule_map at index %d not NULL!", i);
+    for(i = 0; i < SYMBOL_VALUE_MAX; i++) {
+        cr_assert_null(SYMBOL_PTR(RULE_HEAD(&rule_data[i])), "rule_data at index %d not NULL!", i);
     }
 }
 
@@ -333,7 +356,7 @@ Test(rules_suite, init_rules, .timeout=TEST_TIMEOUT) {
 Test(symbols_suite, new_symbol_1, .timeout=TEST_TIMEOUT) {
     int exp_val = 10;
     int exp_numsymb = num_symbols + 1;
-    SYMBOL *exp_addr = &symbol_storage[num_symbols];
+    SYMBOL *exp_addr = SYMBOL_AT(num_symbols);
 
     SYMBOL *ret_symbol = new_symbol(exp_val, NULL);
     SYMBOL exp_symbol = {0};
@@ -350,30 +373,33 @@ Test(symbols_suite, new_symbol_1, .timeout=TEST_TIMEOUT) {
  */
 Test(symbols_suite, new_symbol_2, .timeout=TEST_TIMEOUT) {
     int exp_val = 320;
+    SYMBOL *rule = new_rule(exp_val);
     int exp_numsymb = num_symbols + 1;
-    SYMBOL *exp_addr = &symbol_storage[num_symbols];
+    SYMBOL *exp_addr = SYMBOL_AT(num_symbols);
 
     SYMBOL exp_symbol = {0};
     exp_symbol.value = exp_val;
-    exp_symbol.rule = &exp_symbol;
-    SYMBOL *ret_symbol = new_symbol(exp_val, &exp_symbol);
+    SYMBOL *ret_symbol = new_symbol(exp_val, rule);
 
     cr_assert_eq(ret_symbol, exp_addr, "returned symbol was not properly assigned in symbol storage!");
     cr_assert_eq(num_symbols, exp_numsymb, "num_symbols was not incremented!");
-    cr_assert_eq(exp_symbol.refcnt, 1, "rule passed did not have refcnt incremented!");
-    exp_symbol.refcnt = 0;
+    cr_assert_eq(REFCNT(rule), 1, "rule passed did not have refcnt incremented!");
+    cr_assert_eq(RULE(ret_symbol), rule, "returned symbol does not refer to the rule passed!");
     ASSERT_SYMBOL_STRUCT;
 }
 
 /**
  * new_symbol_3
- * @brief checks for proper abort when symbol_storage is exhausted
+ * @brief checks that symbol storage grows past the reserved number of symbols
  */
-Test(symbols_suite, new_symbol_3,  .signal=SIGABRT, .timeout=TEST_TIMEOUT) {
+Test(symbols_suite, new_symbol_3, .timeout=TEST_TIMEOUT) {
     num_symbols = MAX_SYMBOLS;
-    new_symbol(320, NULL);
+    SYMBOL *ret_symbol = new_symbol(320, NULL);
 
-    cr_assert(1 == 0, "failed to abort when symbol_storage was full!");
+    cr_assert_not_null(ret_symbol, "no symbol returned past the reserved storage!");
+    cr_assert_eq(ret_symbol, SYMBOL_AT(MAX_SYMBOLS), "symbol not taken from the next slot of storage!");
+    cr_assert_eq(num_symbols, MAX_SYMBOLS + 1, "num_symbols was not incremented!");
+    cr_assert_eq(ret_symbol->value, 320, "returned symbol has incorrect value field!");
 }
 
 /**
@@ -397,9 +423,9 @@ Test(rules_suite, new_rule_2, .timeout=TEST_TIMEOUT) {
     SYMBOL *ret_rule = new_rule(exp_value);
 
     cr_assert_not_null(ret_rule, "returned rule was NULL");
-    cr_assert_eq(ret_rule, ret_rule->rule, "new rule didn't initialize 'rule' field to point back to itself!");
-    cr_assert_eq(ret_rule, ret_rule->prev, "new rule didn't initialize 'prev' field to point back to itself!");
-    cr_assert_eq(ret_rule, ret_rule->next, "new rule didn't initialize 'next' field to point back to itself!");
+    cr_assert_eq(ret_rule, RULE(ret_rule), "new rule didn't initialize 'rule' field to point back to itself!");
+    cr_assert_eq(ret_rule, PREV(ret_rule), "new rule didn't initialize 'prev' field to point back to itself!");
+    cr_assert_eq(ret_rule, NEXT(ret_rule), "new rule didn't initialize 'next' field to point back to itself!");
 }
 
 /**
@@ -407,32 +433,37 @@ Test(rules_suite, new_rule_2, .timeout=TEST_TIMEOUT) {
  * @brief check to see if adding a rule functions correctly when main_rule is NULL
  */
 Test(rules_suite, add_rule_1, .timeout=TEST_TIMEOUT) {
-    SYMBOL temp_rule = {0};
+    SYMBOL *temp_rule = new_rule(FIRST_NONTERMINAL);
     main_rule = NULL;
-    add_rule(&temp_rule);
+    add_rule(temp_rule);
 
-    cr_assert_eq(&temp_rule, main_rule, "originally NULL main_rule didn't change to added rule");
-    cr_assert_eq(&temp_rule, main_rule->prevr, "new main rule's 'prevr' field doesn't point back to itself!");
-    cr_assert_eq(&temp_rule, main_rule->nextr, "new main rule's 'nextr' field doesn't point back to itself!");
+    cr_assert_eq(temp_rule, main_rule, "originally NULL main_rule didn't change to added rule");
+    cr_assert_eq(temp_rule, PREVR(main_rule), "new main rule's 'prevr' field doesn't point back to itself!");
+    cr_assert_eq(temp_rule, NEXTR(main_rule), "new main rule's 'nextr' field doesn't point back to itself!");
 }
 
 /**
  * init_digram_hash_1
- * @brief check to see if the digram_table was initialized to NULL
+ * @brief check to see if the digram_table was emptied
  */
 Test(digram_suite, init_digram_hash_1, .timeout=TEST_TIMEOUT) {
-    /* Fill the table with something that isn't NULL*/
+    /* Fill the table with entries */
+    SYMBOL *filler1 = new_symbol(0, NULL), *filler2 = new_symbol(0, NULL);
+    filler1->value = 5;
+    filler2->value = 6;
+    SET_NEXT(filler1, filler2);
     for(int i = 0; i < MAX_DIGRAMS; i++){
-        digram_table[i] = TOMBSTONE;
+        SET_DIGRAM_SLOT(i, filler1);
     }
 
-    /* The table should be initialized to NULL after running this */
+    /* The table should be empty after running this */
     init_digram_hash();
 
     /* Verify that that's the case */
     for(int i = 0; i < MAX_DIGRAMS; i++){
-        cr_assert_null(digram_table[i], "the digram table wasn't successfully initialized to NULL!");
+        cr_assert(!DIGRAM_SLOT_USED(&digram_table[i]), "the digram table wasn't successfully emptied!");
     }
+    cr_assert_null(digram_get(5, 6), "digram from before init_digram_hash was still found!");
 }
 
 /**
@@ -441,18 +472,18 @@ Test(digram_suite, init_digram_hash_1, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_get_1, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = &s1;
+    SET_DIGRAM_SLOT(digram_table_index, s1);
 
     SYMBOL *ret_symbol = digram_get(v1, v2);
-    cr_assert_eq(&s1, ret_symbol, "failed to return existing digram from digram_table (no collision)");
+    cr_assert_eq(s1, ret_symbol, "failed to return existing digram from digram_table (no collision)");
 }
 
 /**
@@ -461,20 +492,20 @@ Test(digram_suite, digram_get_1, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_get_2, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
-    s2.next = NULL;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
+    SET_NEXT(s2, NULL);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = &s2; // Make sure the space in between isn't NULL
-    digram_table[digram_table_index+1] = &s1;
+    SET_DIGRAM_SLOT(digram_table_index, s2); // Make sure the space in between isn't NULL
+    SET_DIGRAM_SLOT(digram_table_index+1, s1);
 
     SYMBOL *ret_symbol = digram_get(v1, v2);
-    cr_assert_eq(&s1, ret_symbol, "failed to return existing digram from digram_table (with collision)");
+    cr_assert_eq(s1, ret_symbol, "failed to return existing digram from digram_table (with collision)");
 }
 
 /**
@@ -484,7 +515,7 @@ Test(digram_suite, digram_get_2, .timeout=TEST_TIMEOUT) {
 Test(digram_suite, digram_get_3, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = NULL;
+    CLEAR_DIGRAM_SLOT(digram_table_index);
 
     SYMBOL *ret_symbol = digram_get(v1, v2);
     cr_assert_null(ret_symbol, "failed to return NULL for a nonexistent digram");
@@ -492,25 +523,30 @@ Test(digram_suite, digram_get_3, .timeout=TEST_TIMEOUT) {
 
 /**
  * digram_get_4
- * @brief check to see if digram_get handles TOMBSTONEs and looping around
+ * @brief check to see if digram_get handles looping around a table full of other digrams
  */
 Test(digram_suite, digram_get_4, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
+
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    SYMBOL *other1 = new_symbol(0, NULL), *other2 = new_symbol(0, NULL);  // A different digram (v2, v1)
+    other1->value = v2;
+    other2->value = v1;
+    SET_NEXT(other1, other2);
 
     int digram_table_index __attribute__((unused)) = DIGRAM_HASH(v1, v2);
     for (int i=0; i<MAX_DIGRAMS; i++) {
-        digram_table[i] = TOMBSTONE;  // Leave a trail of TOMBSTONEs that wraps around the digram_table
+        SET_DIGRAM_SLOT(i, other1);  // Leave a trail of other digrams that wraps around the digram_table
     }
-    digram_table[0] = &s1;  // The digram to be looked up resides immediately on the other side
+    SET_DIGRAM_SLOT(0, s1);  // The digram to be looked up resides immediately on the other side
 
     SYMBOL *ret_symbol = digram_get(v1, v2);
-    cr_assert_eq(&s1, ret_symbol, "failed lookup on an existing digram (wrapping around the table with TOMBSTONEs)");
+    cr_assert_eq(s1, ret_symbol, "failed lookup on an existing digram (wrapping around the table)");
 }
 
 /**
@@ -519,21 +555,21 @@ Test(digram_suite, digram_get_4, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_delete_1, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = &s1;
+    SET_DIGRAM_SLOT(digram_table_index, s1);
 
-    int retval = digram_delete(&s1);  // Attempt to delete s1
+    int retval = digram_delete(s1);  // Attempt to delete s1
     // Since s1 exists in digram_table, we expect return value 0
     cr_assert_eq(0, retval, "expected return value 0 when deleting an existing digram");
-    // Check that s1 was replaced with a TOMBSTONE
-    cr_assert_eq(TOMBSTONE, digram_table[digram_table_index], "expected deleted digram to be replaced with TOMBSTONE");
+    // Check that the slot of s1 is unused again (no tombstone is left behind)
+    cr_assert_null(digram_table[digram_table_index].first, "expected deleted digram's slot to be NULL");
 }
 
 /**
@@ -542,17 +578,17 @@ Test(digram_suite, digram_delete_1, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_delete_2, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = NULL;
+    CLEAR_DIGRAM_SLOT(digram_table_index);
 
-    int retval = digram_delete(&s1);  // Attempt to delete s1
+    int retval = digram_delete(s1);  // Attempt to delete s1
     // Since s1 doesn't exist in digram_table, we expect return value 0
     cr_assert_eq(-1, retval, "expected return value of -1 when attempting to delete a nonexistent digram");
 }
@@ -564,26 +600,26 @@ Test(digram_suite, digram_delete_2, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_delete_3, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0}, s2 = {0};  // Digram 1 (existing in table)
-    SYMBOL s3 = {0}, s4 = {0};  // Digram 2 with same value of Digram 1, (existing after Digram 1 in the table)
+    SYMBOL *s1 = new_symbol(0, NULL), *s2 = new_symbol(0, NULL);  // Digram 1 (existing in table)
+    SYMBOL *s3 = new_symbol(0, NULL), *s4 = new_symbol(0, NULL);  // Digram 2 with same value of Digram 1, (existing after Digram 1 in the table)
 
     /* Assemble Digram 1 */
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     /* Assemble Digram 2 */
-    s3.value = v1;
-    s4.value = v2;
-    s3.next = &s4;
+    s3->value = v1;
+    s4->value = v2;
+    SET_NEXT(s3, s4);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = &s1;  // Insert Digram 1
-    digram_table[digram_table_index+1] = &s3; // Insert Digram 2
+    SET_DIGRAM_SLOT(digram_table_index, s1);  // Insert Digram 1
+    SET_DIGRAM_SLOT(digram_table_index+1, s3); // Insert Digram 2
 
-    int retval = digram_delete(&s3);  // Attempt to delete Digram 2. Hopefully, Digram 1 isn't affected and Digram 2 is deleted
-    cr_assert_eq(&s1, digram_table[digram_table_index], "attempting to delete a digram shouldn't affect other digrams with the same value");
-    cr_assert_eq(TOMBSTONE, digram_table[digram_table_index+1], "expected digram to be deleted and replaced by a TOMBSTONE");
+    int retval = digram_delete(s3);  // Attempt to delete Digram 2. Hopefully, Digram 1 isn't affected and Digram 2 is deleted
+    cr_assert_eq(s1, digram_table[digram_table_index].first, "attempting to delete a digram shouldn't affect other digrams with the same value");
+    cr_assert_null(digram_table[digram_table_index+1].first, "expected digram to be deleted and its slot set to NULL");
     cr_assert_eq(0, retval, "expected return value of 0 when attempting to delete an existing digram");
 }
 
@@ -593,19 +629,19 @@ Test(digram_suite, digram_delete_3, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_put_1, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = NULL;
+    CLEAR_DIGRAM_SLOT(digram_table_index);
 
-    int retval = digram_put(&s1);  // Attempt to insert s1
+    int retval = digram_put(s1);  // Attempt to insert s1
     cr_assert_eq(0, retval, "expected return value of 0 when attempting to insert a new, unique digram");
-    cr_assert_eq(&s1, digram_table[digram_table_index], "new, unique digram wasn't inserted correctly into digram_table");
+    cr_assert_eq(s1, digram_table[digram_table_index].first, "new, unique digram wasn't inserted correctly into digram_table");
 }
 
 /**
@@ -616,25 +652,25 @@ Test(digram_suite, digram_put_2, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
 
     /* Test Digram 1: a digram already in the table */
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    SYMBOL *s1 = new_symbol(0, NULL);
+    SYMBOL *s2 = new_symbol(0, NULL);
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
 
     /* Test Digram 2: a digram with the same value as digram 1, to be "inserted" */
-    SYMBOL s3 = {0};
-    SYMBOL s4 = {0};
-    s3.value = v1;
-    s4.value = v2;
-    s3.next = &s4;
+    SYMBOL *s3 = new_symbol(0, NULL);
+    SYMBOL *s4 = new_symbol(0, NULL);
+    s3->value = v1;
+    s4->value = v2;
+    SET_NEXT(s3, s4);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = &s1;
+    SET_DIGRAM_SLOT(digram_table_index, s1);
 
-    int retval = digram_put(&s3);  // Attempt to insert s2
+    int retval = digram_put(s3);  // Attempt to insert s2
     cr_assert_eq(1, retval, "expected return value of 1 when attempting to insert a non-unique digram");
-    cr_assert_eq(&s1, digram_table[digram_table_index], "digram table changed despite returning 1 after digram_put");
+    cr_assert_eq(s1, digram_table[digram_table_index].first, "digram table changed despite returning 1 after digram_put");
 }
 
 /**
@@ -645,34 +681,42 @@ Test(digram_suite, digram_put_2, .timeout=TEST_TIMEOUT) {
  */
 Test(digram_suite, digram_put_3, .timeout=TEST_TIMEOUT) {
     /* Test Digram: a digram with no second symbol */
-    SYMBOL s1 = {0};
-    s1.value = 5;
-    s1.next = NULL;
+    SYMBOL *s1 = new_symbol(0, NULL);
+    s1->value = 5;
+    SET_NEXT(s1, NULL);
 
     /* Check that you can't insert a digram with no second symbol */
-    int retval = digram_put(&s1);
+    int retval = digram_put(s1);
     cr_assert_eq(-1, retval, "expected return value of -1 when attempting to insert a malformed digram");
 }
 
 /**
- * digram_put_4
- * @brief check to see if inserting a unique digram into the table replaces a TOMBSTONE and returns 0
+ * digram_delete_4
+ * @brief check to see that deleting a digram shifts later digrams of the same probe
+ * sequence back, so that the table is left without any holes in that sequence
  */
-Test(digram_suite, digram_put_4, .timeout=TEST_TIMEOUT) {
+Test(digram_suite, digram_delete_4, .timeout=TEST_TIMEOUT) {
     int v1 = 5, v2 = 6; // Arbitrary
-    SYMBOL s1 = {0};
-    SYMBOL s2 = {0};
+    SYMBOL *s1 = new_symbol(0, NULL), *s2 = new_symbol(0, NULL);  // Digram 1 (in its home slot)
+    SYMBOL *s3 = new_symbol(0, NULL), *s4 = new_symbol(0, NULL);  // Digram 2 with the same home slot (in the following slot)
 
-    s1.value = v1;
-    s2.value = v2;
-    s1.next = &s2;
+    s1->value = v1;
+    s2->value = v2;
+    SET_NEXT(s1, s2);
+
+    s3->value = v1;
+    s4->value = v2;
+    SET_NEXT(s3, s4);
 
     int digram_table_index = DIGRAM_HASH(v1, v2);
-    digram_table[digram_table_index] = TOMBSTONE;  // digram_put should replace this with &s1
+    SET_DIGRAM_SLOT(digram_table_index, s1);
+    SET_DIGRAM_SLOT(digram_table_index+1, s3);
 
-    int retval = digram_put(&s1);  // Attempt to insert s1
-    cr_assert_eq(0, retval, "expected return value of 0 when attempting to insert a new, unique digram");
-    cr_assert_eq(&s1, digram_table[digram_table_index], "inserted digram didn't replace TOMBSTONE");
+    int retval = digram_delete(s1);
+    cr_assert_eq(0, retval, "expected return value of 0 when attempting to delete an existing digram");
+    cr_assert_eq(s3, digram_table[digram_table_index].first, "following digram wasn't shifted back into the hole");
+    cr_assert_null(digram_table[digram_table_index+1].first, "slot vacated by the shifted digram wasn't set to NULL");
+    cr_assert_eq(s3, digram_get(v1, v2), "shifted digram can't be found any more");
 }
 
 /**
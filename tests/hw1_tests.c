@@ -1,6 +1,13 @@
+#define _GNU_SOURCE
 #include <criterion/criterion.h>
 #include <criterion/logging.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "const.h"
+#include "libsequitur.h"
 
 #define TEST_TIMEOUT 10
 
@@ -55,3 +62,629 @@ Test(basecode_tests_suite, help_system_test, .timeout=TEST_TIMEOUT) {
                  "Program exited with %d instead of EXIT_SUCCESS",
 		 return_code);
 }
+
+// Writes a symbol the way the compressor encodes it.
+static void encode_value(FILE *f, int v) {
+    unsigned char *encodeSymbol(unsigned char *p, int value);
+    unsigned char buf[4];
+    fwrite(buf, 1, encodeSymbol(buf, v) - buf, f);
+}
+
+// Checks that the rest of a stream holds exactly the rest of another.
+static void assert_same_contents(FILE *expected, FILE *actual) {
+    int c;
+    long offset = 0;
+    while((c = fgetc(expected)) != EOF) {
+        cr_assert_eq(fgetc(actual), c, "Contents differ at byte %ld", offset);
+        offset++;
+    }
+    cr_assert_eq(fgetc(actual), EOF, "Contents are longer than expected");
+}
+
+Test(basecode_tests_suite, utf_boundary_test, .timeout=TEST_TIMEOUT) {
+    // The last values that take 3 and 4 bytes, as rule heads and in a rule body.
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    fputc(0x81, in);
+    fputc(0x83, in);
+    encode_value(in, FIRST_NONTERMINAL);
+    encode_value(in, 0xffff);
+    encode_value(in, 0x10ffff);
+    fputc(0x85, in);
+    encode_value(in, 0xffff);
+    encode_value(in, 'a');
+    encode_value(in, 'b');
+    fputc(0x85, in);
+    encode_value(in, 0x10ffff);
+    encode_value(in, 'c');
+    encode_value(in, 'd');
+    fputc(0x84, in);
+    fputc(0x82, in);
+
+    // Same bytes as standard UTF-8.
+    unsigned char exp_in[] = {0x81, 0x83, 0xc4, 0x80, 0xef, 0xbf, 0xbf, 0xf4, 0x8f, 0xbf, 0xbf,
+                              0x85, 0xef, 0xbf, 0xbf, 'a', 'b', 0x85, 0xf4, 0x8f, 0xbf, 0xbf,
+                              'c', 'd', 0x84, 0x82};
+    unsigned char got[sizeof(exp_in) + 1];
+    rewind(in);
+    size_t n = fread(got, 1, sizeof(got), in);
+    cr_assert_eq(n, sizeof(exp_in), "Transmission is %zu bytes instead of %zu", n, sizeof(exp_in));
+    cr_assert(memcmp(got, exp_in, n) == 0, "Boundary values not encoded as UTF-8");
+
+    rewind(in);
+    int ret = decompress(in, out);
+    cr_assert_eq(ret, 4, "Decompression wrote %d bytes", ret);
+    rewind(out);
+    char buf[5] = {0};
+    fread(buf, 1, 4, out);
+    cr_assert_str_eq(buf, "abcd", "Decompressed to \"%s\"", buf);
+    fclose(in);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, recycle_reuse_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+    SYMBOL *a = new_symbol('a', NULL);
+    SYMBOL *b = new_symbol('b', NULL);
+    recycle_symbol(a);
+    recycle_symbol(b);
+    int exp_numsymb = num_symbols;
+
+    // Recycled symbols come back most-recently-recycled first, without growing storage.
+    cr_assert_eq(new_symbol('c', NULL), b, "Most recently recycled symbol was not reused");
+    cr_assert_eq(new_symbol('d', NULL), a, "Recycled symbol was not reused");
+    cr_assert_eq(num_symbols, exp_numsymb, "num_symbols grew although recycled symbols were available");
+
+    // Once the recycle stack is empty, allocation continues from symbol storage.
+    cr_assert_eq(new_symbol('e', NULL), SYMBOL_AT(exp_numsymb), "Fresh symbol not taken from storage");
+}
+
+Test(basecode_tests_suite, init_symbols_drops_recycled_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+    SYMBOL *a = new_symbol('a', NULL);
+    new_symbol('b', NULL);
+    recycle_symbol(a);
+
+    init_symbols();
+    cr_assert_eq(new_symbol('c', NULL), SYMBOL_AT(0), "init_symbols did not discard recycled symbols");
+    cr_assert_eq(num_symbols, 1, "num_symbols not counted from zero after init_symbols");
+}
+
+Test(basecode_tests_suite, validargs_large_block_test, .timeout=TEST_TIMEOUT) {
+    char *argv[] = {"bin/sequitur", "-c", "-b", "65535", NULL};
+    int ret = validargs(4, argv);
+    int size = (global_options >> 16) & 0xffff;
+    cr_assert_eq(ret, 0, "Largest block size rejected. Got: %d", ret);
+    cr_assert_eq(size, 65535, "Block size not properly set. Got: %d | Expected: %d", size, 65535);
+
+    char *argv2[] = {"bin/sequitur", "-c", "-b", "65536", NULL};
+    ret = validargs(4, argv2);
+    cr_assert_eq(ret, -1, "Block size over the limit accepted. Got: %d", ret);
+}
+
+Test(basecode_tests_suite, symbol_refs_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+
+    // Links are 32-bit references into symbol storage, not pointers.
+    cr_assert_eq(sizeof(SYMBOL), 12, "SYMBOL is %zu bytes", sizeof(SYMBOL));
+    SYMBOL *a = new_symbol('a', NULL);
+    SYMBOL *b = new_symbol('b', NULL);
+    cr_assert_eq(SYMBOL_REF(a), 1, "Reference to the first symbol is not 1");
+    cr_assert_null(SYMBOL_PTR(0), "Reference 0 does not stand for NULL");
+    cr_assert_null(NEXT(a), "New symbol has a next symbol");
+
+    SET_NEXT(a, b);
+    SET_PREV(b, a);
+    cr_assert_eq(NEXT(a), b, "Next link not followed to the right symbol");
+    cr_assert_eq(PREV(b), a, "Prev link not followed to the right symbol");
+}
+
+Test(basecode_tests_suite, symbol_storage_growth_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+
+    // Storage grows a chunk at a time, and links still work across chunks.
+    SYMBOL *first = new_symbol('a', NULL);
+    num_symbols = 3 * SYMBOL_CHUNK - 1;
+    SYMBOL *last = new_symbol('b', NULL);
+    SYMBOL *next = new_symbol('c', NULL);
+    cr_assert_eq(SYMBOL_REF(last), 3 * SYMBOL_CHUNK, "Wrong reference to the last symbol of a chunk");
+    cr_assert_eq(SYMBOL_REF(next), 3 * SYMBOL_CHUNK + 1, "Wrong reference to the first symbol of a chunk");
+    cr_assert_eq(SYMBOL_PTR(SYMBOL_REF(next)), next, "Reference not followed to the right symbol");
+
+    SET_NEXT(first, next);
+    SET_PREV(next, last);
+    cr_assert_eq(NEXT(first), next, "Next link not followed across chunks");
+    cr_assert_eq(PREV(next), last, "Prev link not followed across chunks");
+}
+
+Test(basecode_tests_suite, digram_table_growth_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(256);
+    reserve_digrams(8);
+    init_symbols();
+    init_digram_hash();
+    int size = MAX_DIGRAMS;
+
+    // Put many more digrams than the table was reserved for.
+    SYMBOL *firsts[100];
+    for(int i = 0; i < 100; i++) {
+        firsts[i] = new_symbol(i, NULL);
+        SYMBOL *second = new_symbol(i + 1, NULL);
+        SET_NEXT(firsts[i], second);
+        cr_assert_eq(digram_put(firsts[i]), 0, "Insert %d failed", i);
+    }
+    cr_assert_gt(MAX_DIGRAMS, size, "Digram table did not grow");
+    cr_assert_geq(MAX_DIGRAMS, 200, "Digram table more than half full: %d slots", MAX_DIGRAMS);
+    for(int i = 0; i < 100; i++) {
+        cr_assert_eq(digram_get(i, i + 1), firsts[i], "Digram %d lost when the table grew", i);
+    }
+}
+
+Test(basecode_tests_suite, rule_value_reuse_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+    init_rules();
+
+    // Fresh values are used up to the last code point, then deleted rules' values.
+    next_nonterminal_value = LAST_NONTERMINAL;
+    SYMBOL *rule = new_rule(new_rule_value());
+    add_rule(new_rule(FIRST_NONTERMINAL));
+    add_rule(rule);
+    cr_assert_eq(rule->value, LAST_NONTERMINAL, "Fresh value not used. Got: %x", rule->value);
+    cr_assert_eq(rule_values_left(), 0, "Values left. Got: %d", rule_values_left());
+
+    delete_rule(rule);
+    cr_assert_eq(rule_values_left(), 1, "Deleted rule's value not freed");
+    cr_assert_eq(new_rule_value(), LAST_NONTERMINAL, "Deleted rule's value not reused");
+}
+
+Test(basecode_tests_suite, context_independence_test, .timeout=TEST_TIMEOUT) {
+    reserve_symbols(16);
+    init_symbols();
+    new_symbol('a', NULL);
+
+    // A fresh context has state of its own, and the previous context is left alone.
+    SEQ_CONTEXT *ctx = new_context();
+    cr_assert_not_null(ctx, "Context not created");
+    SEQ_CONTEXT *prev = use_context(ctx);
+    cr_assert_eq(num_symbols, 0, "New context has symbols: %d", num_symbols);
+    cr_assert_eq(next_nonterminal_value, FIRST_NONTERMINAL, "Bad first nonterminal value");
+    reserve_symbols(16);
+    init_symbols();
+    new_symbol('b', NULL);
+    new_symbol('c', NULL);
+    cr_assert_eq(num_symbols, 2, "Wrong number of symbols in new context: %d", num_symbols);
+
+    use_context(prev);
+    cr_assert_eq(num_symbols, 1, "Previous context changed: %d symbols", num_symbols);
+    cr_assert_eq(SYMBOL_AT(0)->value, 'a', "Previous context's symbol changed");
+    free_context(ctx);
+}
+
+Test(basecode_tests_suite, validargs_jobs_test, .timeout=TEST_TIMEOUT) {
+    int argc = 6;
+    char *argv[] = {"bin/sequitur", "-c", "-j", "4", "-b", "10", NULL};
+    int ret = validargs(argc, argv);
+    int opt = global_options;
+    cr_assert_eq(ret, 0, "Invalid return for valid args.  Got: %d | Expected: 0", ret);
+    cr_assert_eq((opt >> 8) & 0xff, 4, "Number of jobs not properly set. Got: %x", opt);
+    cr_assert_eq((opt >> 16) & 0xffff, 10, "Block size not properly set. Got: %x", opt);
+
+    char *bad_jobs[] = {"bin/sequitur", "-c", "-j", "256", NULL};
+    cr_assert_eq(validargs(4, bad_jobs), -1, "Too many jobs accepted");
+    char *twice[] = {"bin/sequitur", "-c", "-j", "2", "-j", "3", NULL};
+    cr_assert_eq(validargs(6, twice), -1, "-j accepted twice");
+}
+
+Test(basecode_tests_suite, compress_parallel_test, .timeout=TEST_TIMEOUT) {
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *serial = tmpfile();
+    FILE *parallel = tmpfile();
+    int bsize = 64 << 10;
+
+    int ret = compress(in, serial, bsize);
+    rewind(in);
+    int pret = compress_parallel(in, parallel, bsize, 3);
+    cr_assert_neq(ret, EOF, "Serial compression failed");
+    cr_assert_eq(pret, ret, "Parallel compression wrote %d bytes, not %d", pret, ret);
+
+    // The transmissions must be identical.
+    rewind(serial);
+    rewind(parallel);
+    assert_same_contents(serial, parallel);
+    fclose(in);
+    fclose(serial);
+    fclose(parallel);
+}
+
+Test(basecode_tests_suite, decompress_parallel_test, .timeout=TEST_TIMEOUT) {
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    FILE *out = tmpfile();
+
+    // Small blocks give many rules whose encodings contain the EOB byte 0x84.
+    cr_assert_neq(compress(in, compressed, 4 << 10), EOF, "Compression failed");
+    rewind(compressed);
+    int ret = decompress_parallel(compressed, out, 3);
+    cr_assert_eq(ret, 2006599, "Parallel decompression wrote %d bytes", ret);
+
+    rewind(in);
+    rewind(out);
+    assert_same_contents(in, out);
+    fclose(in);
+    fclose(compressed);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, compress_pipeline_test, .timeout=TEST_TIMEOUT) {
+    char *argv[] = {"bin/sequitur", "-c", "-p", "-b", "64", NULL};
+    cr_assert_eq(validargs(5, argv), 0, "-p not accepted");
+    cr_assert(global_options & 0x8, "Pipeline bit wasn't set. Got: %x", global_options);
+    char *with_jobs[] = {"bin/sequitur", "-c", "-p", "-j", "2", NULL};
+    cr_assert_eq(validargs(5, with_jobs), -1, "-p accepted with -j");
+
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *serial = tmpfile();
+    FILE *pipelined = tmpfile();
+    int bsize = 64 << 10;
+
+    int ret = compress(in, serial, bsize);
+    rewind(in);
+    int pret = compress_pipeline(in, pipelined, bsize);
+    cr_assert_neq(ret, EOF, "Serial compression failed");
+    cr_assert_eq(pret, ret, "Pipelined compression wrote %d bytes, not %d", pret, ret);
+
+    rewind(serial);
+    rewind(pipelined);
+    assert_same_contents(serial, pipelined);
+    fclose(in);
+    fclose(serial);
+    fclose(pipelined);
+}
+
+Test(basecode_tests_suite, expand_deep_grammar_test, .timeout=TEST_TIMEOUT) {
+    // A chain of rules, each of which is 'a' followed by the next: too deep to recurse.
+    int depth = 200000;
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    fputc(0x81, in);
+    fputc(0x83, in);
+    for(int i = 0; i < depth; i++) {
+        if(i > 0) {
+            fputc(0x85, in);
+        }
+        encode_value(in, FIRST_NONTERMINAL + i);
+        encode_value(in, 'a');
+        encode_value(in, i + 1 < depth ? FIRST_NONTERMINAL + i + 1 : 'a');
+    }
+    fputc(0x84, in);
+    fputc(0x82, in);
+    rewind(in);
+    int ret = decompress(in, out);
+    cr_assert_eq(ret, depth + 1, "Decompression wrote %d bytes", ret);
+    fclose(in);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, expand_cycle_test, .timeout=TEST_TIMEOUT) {
+    // The second rule refers to itself, so its expansion would never end.
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    fputc(0x81, in);
+    fputc(0x83, in);
+    encode_value(in, FIRST_NONTERMINAL);
+    encode_value(in, 'a');
+    encode_value(in, FIRST_NONTERMINAL + 1);
+    fputc(0x85, in);
+    encode_value(in, FIRST_NONTERMINAL + 1);
+    encode_value(in, 'b');
+    encode_value(in, FIRST_NONTERMINAL + 1);
+    fputc(0x84, in);
+    fputc(0x82, in);
+    rewind(in);
+    int ret = decompress(in, out);
+    cr_assert_eq(ret, EOF, "Decompression of a cyclic grammar returned %d", ret);
+    fclose(in);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, materialize_fallback_test, .timeout=TEST_TIMEOUT) {
+    // Expanding rules into an arena, a small arena and walking the grammar agree.
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    cr_assert_neq(compress(in, compressed, 64 << 10), EOF, "Compression failed");
+    fclose(in);
+
+    size_t limits[] = {MATERIALIZE_MAX, 4096, 0};
+    FILE *outs[3];
+    for(int i = 0; i < 3; i++) {
+        SEQ_CONTEXT *ctx = new_context();
+        cr_assert_not_null(ctx, "Could not create a context");
+        ctx->materialize_max = limits[i];
+        outs[i] = tmpfile();
+        rewind(compressed);
+        int ret = context_decompress(ctx, compressed, outs[i]);
+        cr_assert_eq(ret, 2006599, "Decompression with a limit of %zu wrote %d bytes", limits[i], ret);
+        free_context(ctx);
+        rewind(outs[i]);
+    }
+    assert_same_contents(outs[2], outs[0]);
+    rewind(outs[2]);
+    assert_same_contents(outs[2], outs[1]);
+    fclose(compressed);
+    for(int i = 0; i < 3; i++) {
+        fclose(outs[i]);
+    }
+}
+
+Test(basecode_tests_suite, decompress_mapped_file_test, .timeout=TEST_TIMEOUT) {
+    // A regular file is mapped, and read from where the stream stands.
+    FILE *in = fopen("tests/inputs/jingle_bells.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    fputs("prefix", compressed);
+    cr_assert_neq(compress(in, compressed, 1024), EOF, "Compression failed");
+    long size = ftell(compressed);
+    fseek(in, 0, SEEK_END);
+    long length = ftell(in);
+    fclose(in);
+
+    FILE *out = tmpfile();
+    fseek(compressed, 6, SEEK_SET);
+    int ret = decompress(compressed, out);
+    cr_assert_eq(ret, length, "Decompression wrote %d bytes, not %ld", ret, length);
+    cr_assert_eq(ftell(compressed), size, "Stream was left at %ld, not at the end", ftell(compressed));
+    fclose(compressed);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, compress_files_test, .timeout=TEST_TIMEOUT) {
+    char *argv[] = {"bin/sequitur", "-c", "-i", "tests/inputs/jingle_bells.txt",
+                    "-o", "files_test.seq", NULL};
+    cr_assert_eq(validargs(6, argv), 0, "-i and -o not accepted");
+    cr_assert_str_eq(input_path, "tests/inputs/jingle_bells.txt", "Input file not set");
+    cr_assert_str_eq(output_path, "files_test.seq", "Output file not set");
+    char *twice[] = {"bin/sequitur", "-d", "-o", "a", "-o", "b", NULL};
+    cr_assert_eq(validargs(6, twice), -1, "-o accepted twice");
+    char *missing[] = {"bin/sequitur", "-c", "-i", NULL};
+    cr_assert_eq(validargs(3, missing), -1, "-i accepted without a file");
+
+    // Space set aside for the output is given back when it is closed.
+    cr_assert_eq(validargs(6, argv), 0, "-i and -o not accepted");
+    FILE *in = open_input();
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *out = open_output(in, 1);
+    cr_assert_not_null(out, "Could not open test output");
+    int ret = compress(in, out, 1024);
+    cr_assert_neq(ret, EOF, "Compression failed");
+    cr_assert_eq(close_output(out), 0, "Closing the output failed");
+    fclose(in);
+    struct stat st;
+    cr_assert_eq(stat("files_test.seq", &st), 0, "Output file missing");
+    cr_assert_eq(st.st_size, ret, "Output file has %ld bytes, not %d", (long)st.st_size, ret);
+
+    // The input is not truncated by opening it again as the output.
+    char *same[] = {"bin/sequitur", "-d", "-i", "files_test.seq", "-o", "files_test.seq", NULL};
+    cr_assert_eq(validargs(6, same), 0, "-i and -o not accepted");
+    in = open_input();
+    cr_assert_not_null(in, "Could not open test input");
+    cr_assert_null(open_output(in, 0), "Input opened as the output");
+    fclose(in);
+    cr_assert_eq(stat("files_test.seq", &st), 0, "Input file missing");
+    cr_assert_eq(st.st_size, ret, "Input file has %ld bytes, not %d", (long)st.st_size, ret);
+    int status = system("bin/sequitur -d -i files_test.seq -o files_test.seq 2>/dev/null");
+    cr_assert_neq(WEXITSTATUS(status), EXIT_SUCCESS, "Same input and output accepted");
+    cr_assert_eq(stat("files_test.seq", &st), 0, "Input file missing");
+    cr_assert_eq(st.st_size, ret, "Input file has %ld bytes, not %d", (long)st.st_size, ret);
+    remove("files_test.seq");
+}
+
+Test(basecode_tests_suite, decompress_pipe_test, .timeout=TEST_TIMEOUT) {
+    // Output to a pipe is many buffers long, so with OUTBUF_VMSPLICE the pages of
+    // a buffer are handed over and replaced many times.
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    cr_assert_neq(compress(in, compressed, 64 << 10), EOF, "Compression failed");
+    rewind(compressed);
+    rewind(in);
+
+    int fds[2];
+    cr_assert_eq(pipe(fds), 0, "Could not make a pipe");
+    pid_t pid = fork();
+    cr_assert_neq(pid, -1, "Could not fork");
+    if(pid == 0) {
+        close(*fds);
+        FILE *out = fdopen(*(fds + 1), "w");
+        exit(decompress(compressed, out) == EOF || fclose(out) == EOF);
+    }
+    close(*(fds + 1));
+    FILE *piped = fdopen(*fds, "r");
+    usleep(100000); // Let the pipe fill up first.
+    assert_same_contents(in, piped);
+    int status;
+    waitpid(pid, &status, 0);
+    cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Decompression failed");
+    fclose(piped);
+    fclose(in);
+    fclose(compressed);
+}
+
+Test(basecode_tests_suite, decompress_splice_test, .timeout=TEST_TIMEOUT) {
+    // A reader that splices the output out of the pipe takes the pages themselves,
+    // which must not be written again while it holds them.
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    cr_assert_neq(compress(in, compressed, 64 << 10), EOF, "Compression failed");
+    rewind(compressed);
+    rewind(in);
+
+    int fds[2];
+    int held[2];
+    cr_assert_eq(pipe(fds), 0, "Could not make a pipe");
+    cr_assert_eq(pipe(held), 0, "Could not make a pipe");
+    fcntl(*(held + 1), F_SETPIPE_SZ, 1 << 20);
+    int size = fcntl(*(held + 1), F_GETPIPE_SZ);
+    cr_assert_gt(size, 0, "Could not get the size of a pipe");
+    pid_t pid = fork();
+    cr_assert_neq(pid, -1, "Could not fork");
+    if(pid == 0) {
+        close(*fds);
+        FILE *out = fdopen(*(fds + 1), "w");
+        exit(decompress(compressed, out) == EOF || fclose(out) == EOF);
+    }
+    close(*(fds + 1));
+
+    // Move the output into a second pipe, which holds on to its pages while the
+    // writer goes on, and only then read it.
+    FILE *spliced = tmpfile();
+    char buf[4096];
+    long held_bytes = 0;
+    int done = 0;
+    while(!done) {
+        ssize_t n = splice(*fds, NULL, *(held + 1), NULL, size, SPLICE_F_NONBLOCK);
+        if(n > 0) {
+            held_bytes += n;
+            continue;
+        }
+        cr_assert(n == 0 || errno == EAGAIN, "splice() failed");
+        done = n == 0;
+        if(held_bytes > 0) {
+            usleep(20000);
+            while(held_bytes > 0) {
+                n = read(*held, buf, held_bytes < (long)sizeof(buf) ? held_bytes : (long)sizeof(buf));
+                cr_assert_gt(n, 0, "Could not read spliced output");
+                fwrite(buf, 1, n, spliced);
+                held_bytes -= n;
+            }
+        }
+        else if(!done) {
+            usleep(1000);
+        }
+    }
+    rewind(spliced);
+    assert_same_contents(in, spliced);
+    int status;
+    waitpid(pid, &status, 0);
+    cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Decompression failed");
+    close(*fds);
+    close(*held);
+    close(*(held + 1));
+    fclose(spliced);
+    fclose(in);
+    fclose(compressed);
+}
+
+Test(basecode_tests_suite, uring_test, .timeout=TEST_TIMEOUT) {
+    char *argv[] = {"bin/sequitur", "-d", "-u", NULL};
+    cr_assert_eq(validargs(3, argv), 0, "-u not accepted");
+    cr_assert(global_options & 0x10, "io_uring bit wasn't set. Got: %x", global_options);
+    char *with_pipeline[] = {"bin/sequitur", "-c", "-u", "-p", NULL};
+    cr_assert_eq(validargs(4, with_pipeline), -1, "-u accepted with -p");
+
+    // Files are read ahead and written behind, and left positioned as they are
+    // by compress() and decompress().  Without io_uring, those do the work.
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *serial = tmpfile();
+    FILE *compressed = tmpfile();
+    int bsize = 16 << 10;
+    int ret = compress(in, serial, bsize);
+    rewind(in);
+    fputs("prefix", compressed);
+    int uret = compress_uring(in, compressed, bsize);
+    cr_assert_eq(uret, ret, "Compression wrote %d bytes, not %d", uret, ret);
+    cr_assert_eq(ftell(compressed), 6 + ret, "Output was left at %ld", ftell(compressed));
+    cr_assert_eq(ftell(in), 2006599, "Input was left at %ld", ftell(in));
+    rewind(serial);
+    fseek(compressed, 6, SEEK_SET);
+    assert_same_contents(serial, compressed);
+
+    FILE *out = tmpfile();
+    fseek(compressed, 6, SEEK_SET);
+    ret = decompress_uring(compressed, out);
+    cr_assert_eq(ret, 2006599, "Decompression wrote %d bytes", ret);
+    cr_assert_eq(ftell(compressed), 6 + uret, "Input was left at %ld", ftell(compressed));
+    cr_assert_eq(ftell(out), ret, "Output was left at %ld", ftell(out));
+    rewind(in);
+    rewind(out);
+    assert_same_contents(in, out);
+    fclose(in);
+    fclose(serial);
+    fclose(compressed);
+    fclose(out);
+}
+
+Test(basecode_tests_suite, stream_test, .timeout=TEST_TIMEOUT) {
+    // Input pushed in pieces of any size gives the same transmission as compress(),
+    // and a transmission pushed a byte at a time gives back the input.
+    FILE *in = fopen("tests/inputs/2mb_text_1024.txt", "r");
+    cr_assert_not_null(in, "Could not open test input");
+    FILE *compressed = tmpfile();
+    int bsize = 64 << 10;
+    int size = compress(in, compressed, bsize);
+    cr_assert_neq(size, EOF, "Compression failed");
+    long length = ftell(in);
+    unsigned char *input = malloc(length);
+    unsigned char *transmission = malloc(size);
+    unsigned char *output = malloc(length + 1);
+    rewind(in);
+    rewind(compressed);
+    cr_assert_eq(fread(input, 1, length, in), length, "Could not read test input");
+    cr_assert_eq(fread(transmission, 1, size, compressed), size, "Could not read transmission");
+
+    SEQ_STREAM *s = seq_new_encoder(bsize);
+    cr_assert_not_null(s, "Could not create encoder");
+    long pushed = 0;
+    long pulled = 0;
+    size_t piece = 1;
+    while(pushed < length) {
+        size_t n = length - pushed < piece ? length - pushed : piece;
+        cr_assert_eq(seq_update(s, input + pushed, n), 0, "Encoding failed at byte %ld", pushed);
+        pushed += n;
+        piece = piece * 7 % 200003;
+        pulled += seq_pull(s, output + pulled, length - pulled);
+    }
+    cr_assert_eq(seq_finish(s), 0, "Finishing the encoder failed");
+    pulled += seq_pull(s, output + pulled, length + 1 - pulled);
+    cr_assert_eq(pulled, size, "Encoder wrote %ld bytes, not %d", pulled, size);
+    cr_assert(memcmp(output, transmission, size) == 0, "Transmissions differ");
+    cr_assert_eq(seq_update(s, input, 1), EOF, "Input accepted after finishing");
+    seq_free(s);
+
+    s = seq_new_decoder();
+    cr_assert_not_null(s, "Could not create decoder");
+    pulled = 0;
+    for(int i = 0; i < size; i++) {
+        cr_assert_eq(seq_update(s, transmission + i, 1), 0, "Decoding failed at byte %d", i);
+        pulled += seq_pull(s, output + pulled, length + 1 - pulled);
+    }
+    cr_assert_eq(seq_finish(s), 0, "Finishing the decoder failed");
+    cr_assert_eq(pulled, length, "Decoder wrote %ld bytes, not %ld", pulled, length);
+    cr_assert(memcmp(output, input, length) == 0, "Output differs from the input");
+    seq_free(s);
+
+    // A transmission that is cut short, or has something after EOT, is malformed.
+    s = seq_new_decoder();
+    cr_assert_eq(seq_update(s, transmission, size - 1), 0, "Decoding failed");
+    cr_assert_eq(seq_finish(s), EOF, "Truncated transmission accepted");
+    seq_free(s);
+    s = seq_new_decoder();
+    cr_assert_eq(seq_update(s, transmission, size), 0, "Decoding failed");
+    cr_assert_eq(seq_update(s, transmission, 1), EOF, "Byte after EOT accepted");
+    seq_free(s);
+
+    free(input);
+    free(transmission);
+    free(output);
+    fclose(in);
+    fclose(compressed);
+}